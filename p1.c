@@ -4,6 +4,8 @@
 #define DEBUG 0
 extern int debugflag;
 
+static void switchFrames(int old, int newPID);
+
 void p1_fork(int pid)
 {
     if (DEBUG && debugflag) {
@@ -14,6 +16,16 @@ void p1_fork(int pid)
         return;
     }
 
+    /* The last process in the slot may have quit before the Reclaimer
+     * got to it; the child can't start out with its page table */
+    if (processes[pid % MAXPROC].quitPid != NO_PID) {
+        swapQuitTable(pid % MAXPROC);
+    }
+
+    /* We are still running as the parent. The child gets its fault
+     * priority, and can only lower it with VmSetPriority. */
+    processes[pid % MAXPROC].priority = processes[getpid() % MAXPROC].priority;
+
 } /* p1_fork */
 
 
@@ -31,10 +43,18 @@ void p1_switch(int old, int newPID)
         return;
     }
 
-    int frame, dirty;
+    int frame, dirty, missing;
     PageTableEntryPtr pte;
 
-    /* Go through the old process and unmap the pages */
+    if (EXACT_DIRTY) {
+        switchFrames(old, newPID);
+        vmStats.switches++;
+        return;
+    }
+
+    /* Go through the old process and unmap the pages. The pages it
+     * referenced while it ran are its working set; the reference bits
+     * are cleared so the next run starts over */
     for (int page = 0; page < numPages; page++) {
         pte = &pageTable[old % MAXPROC][page];
         frame = pte->frame;
@@ -50,12 +70,28 @@ void p1_switch(int old, int newPID)
                 frameTable[frame].state = REFERENCED;
             }
 
+            if (dirty > 0) {
+                pte->workingSet = IN_WORKING_SET;
+                USLOSS_MmuSetAccess(frame, dirty & DIRTY);
+            }
+            else {
+                pte->workingSet = NOT_IN_WORKING_SET;
+            }
+
             USLOSS_MmuUnmap(TAG, page);
         }
+        else {
+            if (pte->zeroMapped == ZERO_MAPPED) {
+                USLOSS_MmuUnmap(TAG, page);
+            }
+            pte->workingSet = NOT_IN_WORKING_SET;
+        }
     }   
 
 
-    /* Go through the new process and map the pages */
+    /* Go through the new process and map the pages, counting the pages
+     * of its working set it lost while it was switched out */
+    missing = 0;
     for (int page = 0; page < numPages; page++) {
         pte = &pageTable[newPID % MAXPROC][page];
         frame = pte->frame;
@@ -63,49 +99,81 @@ void p1_switch(int old, int newPID)
         if (frame != PAGE_NOT_IN_FRAME) {
             USLOSS_MmuMap(TAG, page, frame, USLOSS_MMU_PROT_RW);
         }
+        else if (pte->zeroMapped == ZERO_MAPPED) {
+            USLOSS_MmuMap(TAG, page, zeroFrame, USLOSS_MMU_PROT_READ);
+        }
+        else if (pte->workingSet == IN_WORKING_SET) {
+            missing++;
+        }
     }   
+    processes[newPID % MAXPROC].prepage = missing;
 
     vmStats.switches++;
 
 } /* p1_switch */
 
-void p1_quit(int pid)
-{
-    if (DEBUG || debugflag) {
-        USLOSS_Console("p1_quit() called: pid = %d\n", pid);
-    }
-
-    if (vmStarted == VM_STOPPED) {
-        return;
-    }
 
-    PageTableEntryPtr pte;
+/*
+ * With EXACT_DIRTY the frame table already knows which frames are dirty,
+ * so p1_switch only has to change the mappings. The pages in frames are
+ * found through the frame table instead of the page tables, and clean
+ * ones are mapped read-only. The page tables are only walked for a
+ * process that has pages mapped to the zero frame.
+ */
+static void switchFrames(int old, int newPID)
+{
     FrameTableEntryPtr framePtr;
 
-     for (int page = 0; page < numPages; page++) {
-        pte = &pageTable[pid % MAXPROC][page];
+    for (int frame = 0; frame < numFrames; frame++) {
+        framePtr = &frameTable[frame];
 
-        /* If page in a frame, set frame as NOT_USED and zero it out */
-        if (pte->frame != PAGE_NOT_IN_FRAME && pte->state == USED) {
-            framePtr = &frameTable[pte->frame];
-
-            framePtr->state = UNREFERENCED;
-            framePtr->dirty = CLEAN;
-            framePtr->used = NOT_USED;
+        if (framePtr->used == USED && framePtr->pid == old &&
+                pageTable[old % MAXPROC][framePtr->pageNum].frame == frame) {
+            USLOSS_MmuUnmap(TAG, framePtr->pageNum);
+        }
+    }
 
+    for (int page = 0; processes[old % MAXPROC].zeroPages > 0 &&
+            page < numPages; page++) {
+        if (pageTable[old % MAXPROC][page].zeroMapped == ZERO_MAPPED) {
             USLOSS_MmuUnmap(TAG, page);
         }
+    }
+
+    for (int frame = 0; frame < numFrames; frame++) {
+        framePtr = &frameTable[frame];
 
-        /* Set track as unused */
-        if (pte->diskBlock != NOT_ON_DISK) {
-            tracksInUse[pte->diskBlock] = NOT_USED;
+        if (framePtr->used == USED && framePtr->pid == newPID &&
+                pageTable[newPID % MAXPROC][framePtr->pageNum].frame == frame) {
+            USLOSS_MmuMap(TAG, framePtr->pageNum, frame,
+                            pageProtection(frame));
         }
+    }
 
-        /* Zero out the page table entry */
-        pte->state = UNREFERENCED;
-        pte->frame = PAGE_NOT_IN_FRAME;
-        pte->diskBlock = NOT_ON_DISK;
-    }   
+    for (int page = 0; processes[newPID % MAXPROC].zeroPages > 0 &&
+            page < numPages; page++) {
+        if (pageTable[newPID % MAXPROC][page].zeroMapped == ZERO_MAPPED) {
+            USLOSS_MmuMap(TAG, page, zeroFrame, USLOSS_MMU_PROT_READ);
+        }
+    }
+} /* switchFrames */
+
+void p1_quit(int pid)
+{
+    if (DEBUG || debugflag) {
+        USLOSS_Console("p1_quit() called: pid = %d\n", pid);
+    }
+
+    if (vmStarted == VM_STOPPED) {
+        return;
+    }
 
+    /* The page table stays in the slot until swapQuitTable moves the
+     * slot on to its spare, and p1_switch unmaps our pages when the
+     * dispatcher switches away from us. All that is left is to hand
+     * everything else to the Reclaimer; if it is already awake it will
+     * find us too. */
+    processes[pid % MAXPROC].quitPid = pid;
+    MboxCondSend(reclaimMailbox, NULL, 0);
 
 } /* p1_quit */
@@ -19,16 +19,89 @@ extern void mbox_condreceive(systemArgs *args_ptr);
 static void FaultHandler(int  type, void *arg);
 static void vmInit(systemArgs *sysargsPtr);
 static void vmDestroy(systemArgs *sysargsPtr);
+static void vmLock(systemArgs *sysargsPtr);
+static void vmUnlock(systemArgs *sysargsPtr);
+static void vmAdvise(systemArgs *sysargsPtr);
+static void vmCheckpoint(systemArgs *sysargsPtr);
+static void vmSetPriority(systemArgs *sysargsPtr);
 static void *vmInitReal(int mappings, int pages, int frames, int pagers);
 static void vmDestroyReal(void);
+static int vmLockReal(int pid, int firstPage, int lastPage);
+static int vmUnlockReal(int pid, int firstPage, int lastPage);
+static int vmAdviseReal(int pid, int firstPage, int lastPage, int hint);
+static void vmMapFile(systemArgs *sysargsPtr);
+static int vmMapFileReal(int pid, int firstPage, int lastPage, int unit,
+                            int sector, int mode);
+static void vmUnmapFile(systemArgs *sysargsPtr);
+static int vmUnmapFileReal(int pid, int firstPage, int lastPage);
+static int vmCheckpointReal(int pid);
+static void vmLoadCheckpoint(void);
+static int checkpointEntryValid(CheckpointEntry *entry, char *blockUsed);
+static void vmResume(systemArgs *sysargsPtr);
+static int vmResumeReal(int pid);
+static void writeCheckpoint(char *image);
+static void invalidateCheckpoint(void);
+static void requestPage(int pid, int offset);
+static int mapZeroPage(int pid, int pageNum);
+static int writeFault(int pid, int pageNum);
+static void prefetchPage(int pid, int pageNum);
+static void prepageWorkingSet(int pid);
 static int Pager(char *buf);
+static int PagerPool(char *arg);
+static int PoolTimer(char *arg);
+static int Reclaimer(char *arg);
+static void reclaimTable(PageTableEntryPtr table);
+static void flushFilePages(PageTableEntryPtr table, char *buf);
+static void evictFrame(int frameIndex, char *buf);
+static void servicePage(FaultMsgPtr faultPtr, char *buf);
+static void installPage(FaultMsgPtr faultPtr, PageTableEntryPtr table,
+                            int frameIndex);
+static void startFault(FaultMsgPtr faultPtr, PageTableEntryPtr table,
+                        int frameIndex);
+static void startWriteBack(FaultContextPtr context);
+static int DiskWorker(char *arg);
+static void writeBackDone(FaultContextPtr context);
+static void finishFault(int index);
+static void queueRequest(IoRequest *request);
+static int nextRequest(void);
+static int claimFrameRun(int priority);
+static int claimCluster(PageTableEntryPtr table, int pageNum, int priority);
+static void serviceCluster(FaultMsgPtr faultPtr, PageTableEntryPtr table,
+                            int firstFrame, char *buf);
+static void evictCluster(int firstFrame, char *buf);
+static int compactSwap(char *buf);
+static void drainFaults(void);
+static int nextFault(void);
+static void faultLatency(FaultMsgPtr faultPtr);
 void setFrameEntryMembers(int pid, int frameIndex, int state, int dirty, 
                             int pageNum, int used, int pagerOwned);
 void setPageEntryMembers(int pid, int pageNum, int state,
                             int frame, int diskBlock);
+void clearPageEntry(PageTableEntryPtr pte);
+void addQuitTable(int pid, PageTableEntryPtr table);
+QuitTablePtr findQuitTable(PageTableEntryPtr table);
+PageTableEntryPtr ownerTable(int pid);
+void releaseQuitPage(PageTableEntryPtr table, int pageNum);
+void retireQuitTable(QuitTablePtr quit);
+void demoteCluster(PageTableEntryPtr table, int pageNum);
+void dropPage(int pid, int pageNum);
+void leaveZeroPage(int pid, PageTableEntryPtr pte);
 void checkDiskStatus(int status, char *name);
 void readWriteToFrame(int frameIndex, void *dest, void *src);
 int findOpenTrack();
+void releaseResumeEntry(CheckpointEntry *entry);
+int releaseUnclaimed(void);
+int poolLimit(int frames);
+int replaceableFrames(void);
+int findOpenTracks(int count);
+void releaseTrack(int track);
+void readTrack(int track, void *buf, char *name);
+void readPageIn(int track, void *buf, char *name);
+void writeTrack(int track, void *buf, char *name);
+void seekTo(int track, int pageIn);
+void readFileSectors(int unit, int sector, void *buf, char *name);
+void writeFileSectors(int unit, int sector, void *buf, char *name);
+int sectorsInTrack(int unit, int sector);
 void PrintStats();
 
 
@@ -38,14 +111,52 @@ FaultMsg faults[MAXPROC];
 FrameTableEntryPtr frameTable;
 int numFrames;
 int numPages;
+int numPagers;      // # pagers in the pool, changed only by PagerPool
+int minPagers;      // # pagers VmInit asked for
+int pagerLimit;     // most pagers the pool may grow to
+int pagersLeaving;  // # pagers that decided to leave the pool
+int poolGrowing;    // a POOL_GROW request is on its way
+int poolMailbox;
+int poolPID;
+int poolTicking;    // PoolTimer keeps going while this is set
+int faultQueueBusy; // last time the fault queue held more than one fault
 int numTracks;
 int clockHand;
 int clockHandMailbox;
 int frameMailbox;
+int reclaimMailbox;
+int reclaimPID;
+QuitTablePtr quitTables; // page tables of processes that quit, until
+                         //   they are reclaimed
 int pageSize;
 int pagersMailbox;
-int pagerPIDS[MAXPAGERS];
+FaultMsg faultQueue[FAULT_QUEUE_SIZE]; // faults drained from pagersMailbox
+int faultQueueCount;
+int faultQueueMailbox;
+int diskHead;      // track the disk head was last moved to
+int scanDirection; // 1 if the next page-ins go up the disk, -1 if down
+int diskMailbox;   // guards diskHead, scanDirection, ioRequests and
+                   //   inFlight
+int compacting;    // a pager is in compactSwap
+int busyPagers;    // # pagers servicing a fault
+int swapCompact;   // compactSwap found nothing to move the last time
+int zeroFrame;     // frame of zeroes never written pages are read from
+FaultContext contexts[MAX_IN_FLIGHT]; // faults in the pipeline
+int contextMailbox; // indexes of the contexts that are free
+IoRequest ioRequests[IO_QUEUE_SIZE]; // disk requests the disk workers
+                                     //   haven't taken
+int ioQueued;       // # requests in ioRequests
+int ioMailbox;      // one message per request in ioRequests
+int inFlight;       // # contexts in use
 int *tracksInUse;
+int trackSize[USLOSS_DISK_UNITS];   // # sectors in a track of each unit
+int unitSectors[USLOSS_DISK_UNITS]; // # sectors on each unit
+int checkpointTrack;  // first track of the checkpoint image
+int checkpointTracks; // # of tracks reserved for the checkpoint image
+int checkpointEntries; // # of CheckpointEntry the image has room for
+int checkpointValid;  // the image on disk matches the swap tracks
+CheckpointEntry *resumeEntries; // entries of the image VmInit found, for
+int resumeCount;                //   VmResume; NO_SLOT once taken
 int vmStarted;
 void *vmRegion; // start of virtual memory frames
 VmStats  vmStats;
@@ -82,11 +193,14 @@ int start4(char *arg)
     /* user-process access to VM functions */
     systemCallVec[SYS_VMINIT]    = vmInit;
     systemCallVec[SYS_VMDESTROY] = vmDestroy;
-
-    /* Set pagerPIDS to -1 */
-    for (int pager = 0; pager < MAXPAGERS; pager++) {
-        pagerPIDS[pager] = -1;
-    }
+    systemCallVec[SYS_VMLOCK]    = vmLock;
+    systemCallVec[SYS_VMUNLOCK]  = vmUnlock;
+    systemCallVec[SYS_VMADVISE]  = vmAdvise;
+    systemCallVec[SYS_VMCHECKPOINT] = vmCheckpoint;
+    systemCallVec[SYS_VMSETPRIORITY] = vmSetPriority;
+    systemCallVec[SYS_VMMAPFILE] = vmMapFile;
+    systemCallVec[SYS_VMRESUME]  = vmResume;
+    systemCallVec[SYS_VMUNMAPFILE] = vmUnmapFile;
 
     result = Spawn("Start5", start5, NULL, 8*USLOSS_MIN_STACK, 2, &pid);
     if (result != 0) {
@@ -136,7 +250,7 @@ static void vmInit(systemArgs *sysargsPtr)
     status = OK;
 
     /* Error checking */
-    if (pagers > MAXPAGERS) {
+    if (pagers < 1 || pagers > poolLimit(frames)) {
         status = ERROR;
     }
 
@@ -185,7 +299,7 @@ static void vmInit(systemArgs *sysargsPtr)
 void *vmInitReal(int mappings, int pages, int frames, int pagers)
 {
     int status;
-    char name[20];
+    char *zeroes;
 
     CheckMode();
     status = USLOSS_MmuInit(mappings, pages, frames);
@@ -200,18 +314,18 @@ void *vmInitReal(int mappings, int pages, int frames, int pagers)
 
     /* Initialize processes table, and page table */
     for (int process = 0; process < MAXPROC; process++) {
-        pageTable[process] = (PageTableEntry *) malloc(sizeof(PageTableEntry) * pages);
-
-        /* Set default values for page tables */
-        for (int page = 0; page < numPages; page++) {
-            pageTable[process][page].state = UNREFERENCED;
-            pageTable[process][page].frame = PAGE_NOT_IN_FRAME;
-            pageTable[process][page].diskBlock = NOT_ON_DISK;
-        }
+        pageTable[process] = newPageTable();
 
         processes[process].PageTable = pageTable[process];
+        processes[process].spareTable = newPageTable();
         processes[process].numPages = pages;
         processes[process].pagesInUse = 0;
+        processes[process].pagesLocked = 0;
+        processes[process].priority = MAXPRIORITY;
+        processes[process].prepage = 0;
+        processes[process].zeroPages = 0;
+        processes[process].scanPage = 0;
+        processes[process].quitPid = NO_PID;
     }
 
     /* Initialize globals */
@@ -221,25 +335,42 @@ void *vmInitReal(int mappings, int pages, int frames, int pagers)
 
     for (int frame = 0; frame < numFrames; frame++) {
         setFrameEntryMembers(NO_PID, frame, UNREFERENCED, CLEAN, PAGE_NOT_IN_FRAME, NOT_USED, NOT_PAGER_OWNED);
+        frameTable[frame].locked = UNLOCKED;
     }
 
     /* Create the fault, and clockhand mailbox and fault mailboxes */
-    pagersMailbox = MboxCreate(MAXPROC, sizeof(int));
+    pagersMailbox = MboxCreate(MAXPROC, sizeof(FaultMsg));
     clockHandMailbox = MboxCreate(1, 0);
     frameMailbox = MboxCreate(1, 0);
+    reclaimMailbox = MboxCreate(1, 0);
+    faultQueueMailbox = MboxCreate(1, 0);
+    faultQueueCount = 0;
+    quitTables = NULL;
+    diskMailbox = MboxCreate(1, 0);
+    diskHead = 0;
+    scanDirection = 1;
+    compacting = 0;
+    busyPagers = 0;
+    swapCompact = 1;
+    ioMailbox = MboxCreate(IO_QUEUE_SIZE, 0);
+    contextMailbox = MboxCreate(MAX_IN_FLIGHT, sizeof(int));
+    ioQueued = 0;
+    inFlight = 0;
 
     /* Initialize the fault mailboxes for each individual process */
     for (int process = 0; process < MAXPROC; process++) {
         faults[process].replyMbox = MboxCreate(0, 0);
     }
 
-    /* Get size of a page and fork the pagers with buffer */
+    /* Get size of a page and size the pager pool */
     pageSize = USLOSS_MmuPageSize();
-
-    for (int unit = 0; unit < pagers; unit++) {        
-        sprintf(name, "Pager unit %d", unit);
-        pagerPIDS[unit] = fork1(name, Pager, NULL, USLOSS_MIN_STACK, PAGER_PRIORITY);
-    }
+    minPagers = pagers;
+    pagerLimit = poolLimit(frames);
+    numPagers = 0;
+    pagersLeaving = 0;
+    poolGrowing = 0;
+    gettimeofdayReal(&faultQueueBusy);
+    poolMailbox = MboxCreate(pagerLimit, sizeof(int));
 
     /* Zero out vmStat, then initialize */
     memset((char *) &vmStats, 0, sizeof(VmStats));
@@ -252,9 +383,19 @@ void *vmInitReal(int mappings, int pages, int frames, int pagers)
     vmStats.pageIns = 0;
     vmStats.pageOuts = 0;
     vmStats.replaced = 0;
+    vmStats.lockedFrames = 0;
+    vmStats.prefetched = 0;
+    vmStats.resumed = 0;
 
     /* Initialize other vmStats fields */
     int sector, track, disk, blocks;
+
+    /* Remember the size of every unit for VmMapFile */
+    for (int unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        diskSizeReal(unit, &sector, &trackSize[unit], &disk);
+        unitSectors[unit] = trackSize[unit] * disk;
+    }
+
     diskSizeReal(DISK1, &sector, &track, &disk);
 
     blocks = ((sector * track) / pageSize) * disk;
@@ -263,9 +404,63 @@ void *vmInitReal(int mappings, int pages, int frames, int pagers)
     tracksInUse = calloc(disk, sizeof(int));
     numTracks = disk;
 
+    /* Reserve the tracks at the end of the disk for the checkpoint image,
+     * with room for every track and a VM region of file mapped pages */
+    checkpointTracks = (sizeof(CheckpointHeader) +
+            (numTracks + numPages) * sizeof(CheckpointEntry) +
+            pageSize - 1) / pageSize;
+    checkpointTrack = numTracks - checkpointTracks;
+    checkpointEntries = (checkpointTracks * pageSize -
+            sizeof(CheckpointHeader)) / sizeof(CheckpointEntry);
+
+    for (int reserved = checkpointTrack; reserved < numTracks; reserved++) {
+        tracksInUse[reserved] = USED;
+        vmStats.freeDiskBlocks--;
+    }
+
     /* Create vm Region */
     vmRegion = USLOSS_MmuRegion(&numPages);
 
+    /* Keep the last frame as the zero frame, filled with zeroes once.
+     * It looks pager owned and locked so nothing replaces it. */
+    zeroFrame = PAGE_NOT_IN_FRAME;
+    if (ZERO_PAGE && numFrames > 1) {
+        zeroFrame = numFrames - 1;
+        setFrameEntryMembers(NO_PID, zeroFrame, UNREFERENCED, CLEAN,
+                                PAGE_NOT_IN_FRAME, USED, PAGER_OWNED);
+        frameTable[zeroFrame].locked = LOCKED;
+        vmStats.freeFrames--;
+
+        zeroes = (char *) calloc(pageSize, sizeof(char));
+        readWriteToFrame(zeroFrame, vmRegion, zeroes);
+        free(zeroes);
+    }
+
+    /* Set up the fault pipeline and fork its disk workers */
+    if (DISK_WORKERS > 0) {
+        for (int context = 0; context < MAX_IN_FLIGHT; context++) {
+            contexts[context].inBuf = (char *) malloc(pageSize);
+            contexts[context].outBuf = (char *) malloc(pageSize);
+            MboxSend(contextMailbox, (void *) &context, sizeof(int));
+        }
+        for (int worker = 0; worker < DISK_WORKERS; worker++) {
+            fork1("Disk worker", DiskWorker, NULL, USLOSS_MIN_STACK,
+                    PAGER_PRIORITY);
+        }
+    }
+
+    /* Fork the pager pool, which forks the pagers */
+    poolPID = fork1("Pager pool", PagerPool, NULL, USLOSS_MIN_STACK,
+                    PAGER_PRIORITY);
+    reclaimPID = fork1("Reclaimer", Reclaimer, NULL, USLOSS_MIN_STACK,
+                    PAGER_PRIORITY);
+    poolTicking = 1;
+    fork1("Pool timer", PoolTimer, NULL, USLOSS_MIN_STACK, PAGER_PRIORITY);
+
+    /* Pick up the pages of the last checkpoint, if there is one, for
+     * the processes to claim with VmResume */
+    vmLoadCheckpoint();
+
     vmStarted = VM_STARTED;
     return vmRegion;
 } /* vmInitReal */
@@ -318,23 +513,45 @@ void vmDestroyReal(void)
     USLOSS_MmuDone();
 
     int joinStatus;
+    QuitTablePtr quit;
     
-    /*  Kill the pagers here. */
+    /*  Kill the pagers here, the pool joins them then quits. The pool
+     *  timer quits the next time it wakes up. */
+    poolTicking = 0;
     MboxRelease(pagersMailbox);
-    for (int pager = 0; pager < MAXPAGERS; pager++) {
-        if (pagerPIDS[pager] == -1) {
-            break;
-        }
+    MboxRelease(poolMailbox);
+    MboxRelease(reclaimMailbox);
+    join(&joinStatus);
+    join(&joinStatus);
+    join(&joinStatus);
 
-        join(&joinStatus);
+    /* The pagers are gone, so nothing new enters the fault pipeline */
+    MboxRelease(ioMailbox);
+    MboxRelease(contextMailbox);
+    if (DISK_WORKERS > 0) {
+        for (int worker = 0; worker < DISK_WORKERS; worker++) {
+            join(&joinStatus);
+        }
+        for (int context = 0; context < MAX_IN_FLIGHT; context++) {
+            free(contexts[context].inBuf);
+            free(contexts[context].outBuf);
+        }
     }
 
-    /* Free page table memory */
+    /* Free page table memory, with the tables of processes that quit */
+    while (quitTables != NULL) {
+        quit = quitTables;
+        quitTables = quit->next;
+        free(quit->table);
+        free(quit);
+    }
     for (int process = 0; process < MAXPROC; process++) {
         free(pageTable[process]);
+        free(processes[process].spareTable);
     }
 
-    /* Free frame table and track array */
+    /* Free frame table, track array and checkpoint entries */
+    free(resumeEntries);
     free(frameTable);
     free(tracksInUse);
 
@@ -345,353 +562,3924 @@ void vmDestroyReal(void)
 /*
  *----------------------------------------------------------------------
  *
- * PrintStats --
+ * vmLock --
  *
- *      Print out VM statistics.
+ * Stub for the VmLock system call. arg1 is the address inside the
+ * VM region and arg2 the length in bytes of the range to pin.
  *
  * Results:
- *      None
+ *      None.
  *
  * Side effects:
- *      Stuff is printed to the USLOSS_Console.
+ *      The pages of the range are faulted in and pinned.
  *
  *----------------------------------------------------------------------
  */
-void PrintStats(void)
+static void vmLock(systemArgs *sysargsPtr)
 {
-    USLOSS_Console("VmStats\n");
-    USLOSS_Console("pages:          %d\n", vmStats.pages);
-    USLOSS_Console("frames:         %d\n", vmStats.frames);
-    USLOSS_Console("diskBlocks:     %d\n", vmStats.diskBlocks);
-    USLOSS_Console("freeFrames:     %d\n", vmStats.freeFrames);
-    USLOSS_Console("freeDiskBlocks: %d\n", vmStats.freeDiskBlocks);
-    USLOSS_Console("switches:       %d\n", vmStats.switches);
-    USLOSS_Console("faults:         %d\n", vmStats.faults);
-    USLOSS_Console("new:            %d\n", vmStats.new);
-    USLOSS_Console("pageIns:        %d\n", vmStats.pageIns);
-    USLOSS_Console("pageOuts:       %d\n", vmStats.pageOuts);
-    USLOSS_Console("replaced:       %d\n", vmStats.replaced);
-} /* PrintStats */
+    CheckMode();
+
+    long offset, length;
+
+    offset = (long) ((char *) sysargsPtr->arg1 - (char *) vmRegion);
+    length = (long) sysargsPtr->arg2;
+
+    /* Error checking */
+    if (vmStarted != VM_STARTED || length < 1 || offset < 0 ||
+            offset + length > (long) numPages * pageSize) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    sysargsPtr->arg4 = (void *) (long) vmLockReal(getpid(), offset / pageSize,
+                                        (offset + length - 1) / pageSize);
+} /* vmLock */
 
 
 /*
  *----------------------------------------------------------------------
  *
- * FaultHandler
+ * vmUnlock --
  *
- * Handles an MMU interrupt. Simply stores information about the
- * fault in a queue, wakes a waiting pager, and blocks until
- * the fault has been handled.
+ * Stub for the VmUnlock system call. Takes the same arguments as
+ * VmLock.
  *
  * Results:
- * None.
+ *      None.
  *
  * Side effects:
- * The current process is blocked until the fault is handled.
+ *      The pages of the range can be replaced again.
  *
  *----------------------------------------------------------------------
  */
-static void FaultHandler(int  type /* USLOSS_MMU_INT */,
-             void *arg  /* Offset within VM region */)
+static void vmUnlock(systemArgs *sysargsPtr)
 {
-    int cause, pid;
-    FaultMsgPtr faultMsg;
-    pid = getpid();
+    CheckMode();
 
-    assert(type == USLOSS_MMU_INT);
-    cause = USLOSS_MmuGetCause();
-    assert(cause == USLOSS_MMU_FAULT);
-    vmStats.faults++;
+    long offset, length;
 
-    faultMsg = &faults[pid % MAXPROC];
-    faultMsg->pid = pid;
-    faultMsg->offset = (long) arg;
-    
+    offset = (long) ((char *) sysargsPtr->arg1 - (char *) vmRegion);
+    length = (long) sysargsPtr->arg2;
 
-    MboxSend(pagersMailbox, (void *) (&pid), sizeof(int));
-    MboxReceive(faultMsg->replyMbox, NULL, 0);
-} /* FaultHandler */
+    /* Error checking */
+    if (vmStarted != VM_STARTED || length < 1 || offset < 0 ||
+            offset + length > (long) numPages * pageSize) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
 
+    sysargsPtr->arg4 = (void *) (long) vmUnlockReal(getpid(), offset / pageSize,
+                                        (offset + length - 1) / pageSize);
+} /* vmUnlock */
 
 
 /*
  *----------------------------------------------------------------------
  *
- * clockAlgorithm
+ * vmLockReal --
  *
- * 
+ * Called by vmLock.
+ * Faults in every page from firstPage to lastPage and pins its frame
+ * so the clock algorithm won't pick it. The pins are charged against
+ * the MAXLOCKEDPAGES limit of the process, and we always leave one
+ * frame that can still be replaced for every pager in the pool.
  *
  * Results:
- * Returns the index of the next frame to use
+ *      OK, or ERROR if the pins would go over a limit.
  *
  * Side effects:
- * Increments the clockHand
+ *      Pages are read in, frames are locked.
  *
  *----------------------------------------------------------------------
  */
-static int clockAlgorithm(PageTableEntryPtr pageToLoad) {
-    FrameTableEntryPtr curFrame;
-    int frameToReturn;
-
-    frameToReturn = 0;
+static int vmLockReal(int pid, int firstPage, int lastPage)
+{
+    int toLock, evicting;
+    Process *proc;
+    PageTableEntryPtr pte;
 
-    /* Look for an unused frame */
-    for (int frame = 0; frame < numFrames; frame++) {
-        curFrame = &frameTable[frame];
+    proc = &processes[pid % MAXPROC];
+    toLock = 0;
 
-        if (curFrame->used == NOT_USED &&
-            curFrame->pagerOwned == NOT_PAGER_OWNED) {
-            setFrameEntryMembers(curFrame->pid, frame, UNREFERENCED, curFrame->dirty, curFrame->pageNum, NOT_USED, PAGER_OWNED);
-            return frame;
+    for (int page = firstPage; page <= lastPage; page++) {
+        if (pageTable[pid % MAXPROC][page].locked == UNLOCKED) {
+            toLock++;
         }
     }
 
+    if (proc->pagesLocked + toLock > MAXLOCKEDPAGES ||
+            replaceableFrames() - toLock < numPagers + poolGrowing) {
+        return ERROR;
+    }
 
-    /* Now using the clock hand look for the first unreferenced frame */
-    MboxSend(clockHandMailbox, NULL, 0);
+    for (int page = firstPage; page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
 
-    while (1) {
-        curFrame = &frameTable[clockHand];
+        /* The page can be replaced again before we get to lock it, so
+         * keep faulting it in until it is in a frame no pager owns. If
+         * a pager is evicting it, wait for the pager to let go of it. */
+        while (pte->locked == UNLOCKED) {
+            if (pte->frame == PAGE_NOT_IN_FRAME) {
+                requestPage(pid, page * pageSize);
+            }
 
-        /* If the state is unreferenced and not pager owned take the frame */
-        if (curFrame->state == UNREFERENCED &&
-                curFrame->pagerOwned == NOT_PAGER_OWNED) {
-            setFrameEntryMembers(curFrame->pid, clockHand, curFrame->state, curFrame->dirty, curFrame->pageNum, curFrame->used, PAGER_OWNED);
-            frameToReturn = clockHand;
-            clockHand = (clockHand+1) % numFrames;
-            break;
-        }
+            MboxSend(frameMailbox, NULL, 0);
+            MboxSend(clockHandMailbox, NULL, 0);
+            evicting = pte->frame != PAGE_NOT_IN_FRAME &&
+                    frameTable[pte->frame].pagerOwned == PAGER_OWNED;
+            if (evicting) {
+                pte->waiter = faults[pid % MAXPROC].replyMbox;
+            }
+            else if (pte->frame != PAGE_NOT_IN_FRAME) {
+                demoteCluster(pageTable[pid % MAXPROC], page);
+                pte->locked = LOCKED;
+                frameTable[pte->frame].locked = LOCKED;
+                proc->pagesLocked++;
+                vmStats.lockedFrames++;
+            }
+            MboxReceive(clockHandMailbox, NULL, 0);
+            MboxReceive(frameMailbox, NULL, 0);
 
-        if (curFrame->pagerOwned != PAGER_OWNED) {
-            USLOSS_MmuSetAccess(clockHand, (0 | curFrame->dirty));
-            curFrame->state = UNREFERENCED;            
+            if (evicting) {
+                MboxReceive(faults[pid % MAXPROC].replyMbox, NULL, 0);
+            }
         }
-
-        clockHand = (clockHand+1) % numFrames;
     }
 
-    MboxReceive(clockHandMailbox, NULL, 0);
-
-    return frameToReturn;
-}
+    return OK;
+} /* vmLockReal */
 
 
 /*
  *----------------------------------------------------------------------
  *
- * Pager 
+ * vmUnlockReal --
  *
- * Kernel process that handles page faults and does page replacement.
+ * Called by vmUnlock.
+ * Releases the pins on the pages from firstPage to lastPage.
  *
  * Results:
- * Maps a page to a frame
+ *      OK
  *
  * Side effects:
- * Changes to the mmu, frameTable, and pageTable
+ *      Frames are unlocked.
  *
  *----------------------------------------------------------------------
  */
-static int Pager(char *buf)
+static int vmUnlockReal(int pid, int firstPage, int lastPage)
 {
-    int pid, frameIndex, pageNum, diskStatus, mailboxStatus;
-    FaultMsgPtr faultPtr;
-    FrameTableEntryPtr frameToUse;
-    PageTableEntryPtr pageToLoad, pageToChange;
-
-    /* Allocate memory for the buffer */
-    buf = (char *) malloc(sizeof(char) * pageSize);
-    pid = 0;
-
-    while(1) {
-        /* Mbox receive will tell us the pid */
-        mailboxStatus = MboxReceive(pagersMailbox, (void *) &pid, sizeof(int));
-        if (mailboxStatus == MAILBOX_RELEASED) {
-            free(buf);
-            return 0;
-        }
-        faultPtr = &faults[pid % MAXPROC];
-
-        /* Find the page number based on the addr the fault happened */
-        pageNum = faultPtr->offset / pageSize;
-        pageToLoad = &pageTable[pid % MAXPROC][pageNum];
-        
-        /* Find frame to use with clockAlgorithm */  
-        frameIndex = clockAlgorithm(pageToLoad);
-        frameToUse = &frameTable[frameIndex];
-        // USLOSS_Console("\npid %d: page %d set to frame %d\n", pid, pageNum, frameIndex);
-
-        /* Update the page table of the process that owns the frame */
-        if (frameToUse->used == USED) {
-            int indexPageToSave, pidToSave;
-
-            indexPageToSave = frameToUse->pageNum;
-            pidToSave = frameToUse->pid;
-            pageToChange = &pageTable[pidToSave % MAXPROC][indexPageToSave];
-
-            /* Save frame into disk */
-            if (frameToUse->dirty >= DIRTY) {
-
-                /* See if this is our first time storing frame on disk */
-                if (pageToChange->diskBlock == NOT_ON_DISK) {
-                    pageToChange->diskBlock = findOpenTrack();
-                }
-
-                /* Increment page out, copy frame to buffer then to disk */
-                vmStats.pageOuts++;
+    PageTableEntryPtr pte;
 
-                readWriteToFrame(frameIndex, buf, vmRegion);
-                diskStatus = diskWriteReal(DISK1, pageToChange->diskBlock,
-                        TRACK_START, SECTORS_IN_FRAME, (void *) buf);
-                checkDiskStatus(diskStatus, "Pager(): writing to disk");
-            }
-            
-            /* Set page table entry on old process */
-            setPageEntryMembers(pidToSave, indexPageToSave, REFERENCED,
-                                    PAGE_NOT_IN_FRAME, pageToChange->diskBlock);
-        }
-
-        /* Check if we need to read from disk or zero out frame */
-        if (pageToLoad->diskBlock != NOT_ON_DISK) {
-            /* Copy page from disk into buffer then into frame */
-            vmStats.pageIns++;
-            diskStatus = diskReadReal(DISK1, pageToLoad->diskBlock,
-                    TRACK_START, SECTORS_IN_FRAME, (void *) buf);
-            checkDiskStatus(diskStatus, "Pager(): reading from disk");
-            readWriteToFrame(frameIndex, vmRegion, buf);
-        }
-        else {
-            memset(buf, 0, pageSize);
-            readWriteToFrame(frameIndex, vmRegion, buf);
-        }
+    MboxSend(clockHandMailbox, NULL, 0);
+    for (int page = firstPage; page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
 
-        /* Set members inside frame entry and process page table */
-        if (pageToLoad->state == UNREFERENCED) {
-            vmStats.new++;
+        if (pte->locked == LOCKED) {
+            frameTable[pte->frame].locked = UNLOCKED;
+            pte->locked = UNLOCKED;
+            processes[pid % MAXPROC].pagesLocked--;
+            vmStats.lockedFrames--;
         }
-
-        setFrameEntryMembers(pid, frameIndex, UNREFERENCED, CLEAN, pageNum, USED, NOT_PAGER_OWNED);
-        setPageEntryMembers(pid, pageNum, REFERENCED, frameIndex,
-                            pageToLoad->diskBlock);
-
-        /* Set access bit */
-        USLOSS_MmuSetAccess(frameIndex, 0);
-
-        MboxSend(faultPtr->replyMbox, NULL, 0);
     }
-    return 0;
-} /* Pager */
+    MboxReceive(clockHandMailbox, NULL, 0);
+
+    return OK;
+} /* vmUnlockReal */
 
 
 /*
  *----------------------------------------------------------------------
  *
- * setFrameEntryMembers
+ * vmAdvise --
  *
- * Helper function to set member of a FrameTableEntry struct.
+ * Stub for the VmAdvise system call. arg1 and arg2 give the range as
+ * for VmLock, arg3 is one of the VM_ADVISE hints.
  *
  * Results:
- * None.
+ *      None.
  *
  * Side effects:
- * Will have changed the members of a FrameTableEntry struct
+ *      See vmAdviseReal.
  *
  *----------------------------------------------------------------------
  */
-
-void setFrameEntryMembers(int pid, int frameIndex, int state, int dirty, 
-                            int pageNum, int used, int pagerOwned)
+static void vmAdvise(systemArgs *sysargsPtr)
 {
-    FrameTableEntryPtr frameToUpdate = &frameTable[frameIndex];
+    CheckMode();
 
-    frameToUpdate->pid = pid;
-    frameToUpdate->state = state;
-    frameToUpdate->dirty = dirty;
-    frameToUpdate->pageNum = pageNum;
-    frameToUpdate->used = used;
-    frameToUpdate->pagerOwned = pagerOwned;
-}
+    long offset, length, hint;
+
+    offset = (long) ((char *) sysargsPtr->arg1 - (char *) vmRegion);
+    length = (long) sysargsPtr->arg2;
+    hint = (long) sysargsPtr->arg3;
+
+    /* Error checking */
+    if (vmStarted != VM_STARTED || length < 1 || offset < 0 ||
+            offset + length > (long) numPages * pageSize) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    if (hint < VM_ADVISE_NORMAL || hint > VM_ADVISE_DONTNEED) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    sysargsPtr->arg4 = (void *) (long) vmAdviseReal(getpid(), offset / pageSize,
+                                        (offset + length - 1) / pageSize, hint);
+} /* vmAdvise */
 
 
 /*
  *----------------------------------------------------------------------
  *
- * setPageEntryMembers
+ * vmAdviseReal --
  *
- * Helper function to set member of a PageTableEntry struct.
+ * Called by vmAdvise.
+ * NORMAL, SEQUENTIAL and RANDOM are remembered in the page table and
+ * used by the pager for read-ahead and by the clock algorithm.
+ * WILLNEED queues a prefetch for every page not in a frame, without
+ * waiting for it. DONTNEED throws the pages away: frames and disk
+ * blocks are freed without writing anything back, and the next touch
+ * gets a zero filled page, or a fresh copy of a mapped file page.
+ * Dirty pages of a shared file mapping are kept.
  *
  * Results:
- * None.
+ *      OK
  *
  * Side effects:
- * Will have changed the members of a PageTableEntry struct
+ *      Page table, frame table and track changes.
  *
  *----------------------------------------------------------------------
  */
-
-void setPageEntryMembers(int pid, int pageNum, int state,
-                            int frame, int diskBlock)
+static int vmAdviseReal(int pid, int firstPage, int lastPage, int hint)
 {
-    PageTableEntryPtr pageToUpdate = &pageTable[pid % MAXPROC][pageNum];
+    int access;
+    PageTableEntryPtr pte;
+    FrameTableEntryPtr framePtr;
 
-    pageToUpdate->state = state;
-    pageToUpdate->frame = frame;
-    pageToUpdate->diskBlock = diskBlock;
-}
+    if (hint == VM_ADVISE_WILLNEED) {
+        for (int page = firstPage; page <= lastPage; page++) {
+            prefetchPage(pid, page);
+        }
+        return OK;
+    }
+
+    if (hint != VM_ADVISE_DONTNEED) {
+        for (int page = firstPage; page <= lastPage; page++) {
+            pageTable[pid % MAXPROC][page].advice = hint;
+        }
+        return OK;
+    }
+
+    /* Keep pagers from claiming or evicting the pages while we drop them */
+    MboxSend(frameMailbox, NULL, 0);
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    for (int page = firstPage; page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
+
+        if (pte->busy == BUSY || pte->locked == LOCKED) {
+            continue;
+        }
+
+        if (pte->frame != PAGE_NOT_IN_FRAME) {
+            framePtr = &frameTable[pte->frame];
+
+            /* A pager is evicting this frame, let it finish */
+            if (framePtr->pagerOwned == PAGER_OWNED) {
+                continue;
+            }
+
+            /* Writes to a shared file mapping aren't ours to throw away */
+            USLOSS_MmuGetAccess(pte->frame, &access);
+            if (pte->fileUnit != NOT_MAPPED &&
+                    pte->fileMode == VM_MAP_SHARED &&
+                    ((access & DIRTY) != 0 || framePtr->dirty >= DIRTY)) {
+                continue;
+            }
+        }
+
+        dropPage(pid, page);
+    }
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+    MboxReceive(frameMailbox, NULL, 0);
+
+    return OK;
+} /* vmAdviseReal */
 
 
 /*
  *----------------------------------------------------------------------
  *
- * checkDiskStatus
+ * vmMapFile --
  *
- * Helper function to check disk status
+ * Stub for the VmMapFile system call. arg1 is the page aligned address
+ * inside the VM region and arg2 the length in bytes of the range to
+ * map, arg5 the disk unit and arg3 the first sector of the file on it.
+ * Page i of the range is backed by the SECTORS_IN_FRAME sectors from
+ * arg3 + i * SECTORS_IN_FRAME on, which may run over into the next
+ * track. arg4 is VM_MAP_SHARED or VM_MAP_PRIVATE.
  *
  * Results:
- * None.
+ *      None.
  *
  * Side effects:
- * Halt USLOSS
+ *      See vmMapFileReal.
  *
  *----------------------------------------------------------------------
  */
-
-void checkDiskStatus(int status, char *name)
+static void vmMapFile(systemArgs *sysargsPtr)
 {
-    if (status != USLOSS_DEV_READY) {
-        USLOSS_Console("Error %s. Halting...");
-        USLOSS_Halt(1);
+    CheckMode();
+
+    long offset, length, sector, mode, unit;
+    int pages;
+
+    offset = (long) ((char *) sysargsPtr->arg1 - (char *) vmRegion);
+    length = (long) sysargsPtr->arg2;
+    sector = (long) sysargsPtr->arg3;
+    mode = (long) sysargsPtr->arg4;
+    unit = (long) sysargsPtr->arg5;
+
+    /* Error checking */
+    if (vmStarted != VM_STARTED || length < 1 || offset < 0 ||
+            offset % pageSize != 0 ||
+            offset + length > (long) numPages * pageSize) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    /* The swap disk belongs to the pagers */
+    if (unit < 0 || unit >= USLOSS_DISK_UNITS || unit == DISK1 ||
+            (mode != VM_MAP_SHARED && mode != VM_MAP_PRIVATE)) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    pages = (length + pageSize - 1) / pageSize;
+    if (sector < 0 ||
+            sector + (long) pages * SECTORS_IN_FRAME > unitSectors[unit]) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
     }
-}
+
+    sysargsPtr->arg4 = (void *) (long) vmMapFileReal(getpid(),
+                        offset / pageSize, offset / pageSize + pages - 1,
+                        unit, sector, mode);
+} /* vmMapFile */
 
 
 /*
  *----------------------------------------------------------------------
  *
- * readWriteToFrame
+ * vmMapFileReal --
  *
- * Helper function to check disk status
+ * Called by vmMapFile.
+ * Backs the pages from firstPage to lastPage with sectors of the given
+ * unit, starting at sector, instead of zero filled pages. Whatever the pages held before
+ * is thrown away as with VM_ADVISE_DONTNEED. The pagers read a mapped
+ * page from its track the first time it is touched, and drop it
+ * without writing anything while it is clean. A dirty page is written
+ * back to its sectors if the mapping is VM_MAP_SHARED, and to swap like
+ * any other page if it is VM_MAP_PRIVATE. VmUnmapFile undoes this.
  *
  * Results:
- * None.
+ *      OK, or ERROR if a page of the range is pinned, already mapped or
+ *      being moved by a pager.
  *
  * Side effects:
- * Reads or writes to a frame
+ *      Page table, frame table and track changes.
  *
  *----------------------------------------------------------------------
  */
-
-void readWriteToFrame(int frameIndex, void *dest, void *src)
+static int vmMapFileReal(int pid, int firstPage, int lastPage, int unit,
+                            int sector, int mode)
 {
-    /* Map frame to PAGER_PAGE( == 0) then write or read from frame */  
-    USLOSS_MmuMap(TAG, PAGER_PAGE, frameIndex, USLOSS_MMU_PROT_RW);
-    memcpy(dest, src, pageSize);
-    USLOSS_MmuUnmap(TAG, PAGER_PAGE);
-}
+    int result;
+    PageTableEntryPtr pte;
 
+    result = OK;
 
-/*
- *----------------------------------------------------------------------
- *
+    MboxSend(frameMailbox, NULL, 0);
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    for (int page = firstPage; page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
+
+        if (pte->busy == BUSY || pte->locked == LOCKED ||
+                pte->fileUnit != NOT_MAPPED ||
+                (pte->frame != PAGE_NOT_IN_FRAME &&
+                 frameTable[pte->frame].pagerOwned == PAGER_OWNED)) {
+            result = ERROR;
+        }
+    }
+
+    for (int page = firstPage; result == OK && page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
+
+        dropPage(pid, page);
+        pte->fileUnit = unit;
+        pte->fileSector = sector + (page - firstPage) * SECTORS_IN_FRAME;
+        pte->fileMode = mode;
+    }
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+    MboxReceive(frameMailbox, NULL, 0);
+
+    return result;
+} /* vmMapFileReal */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmUnmapFile --
+ *
+ * Stub for the VmUnmapFile system call. arg1 is the page aligned
+ * address inside the VM region and arg2 the length in bytes of the
+ * range to unmap.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      See vmUnmapFileReal.
+ *
+ *----------------------------------------------------------------------
+ */
+static void vmUnmapFile(systemArgs *sysargsPtr)
+{
+    CheckMode();
+
+    long offset, length;
+
+    offset = (long) ((char *) sysargsPtr->arg1 - (char *) vmRegion);
+    length = (long) sysargsPtr->arg2;
+
+    /* Error checking */
+    if (vmStarted != VM_STARTED || length < 1 || offset < 0 ||
+            offset % pageSize != 0 ||
+            offset + length > (long) numPages * pageSize) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    sysargsPtr->arg4 = (void *) (long) vmUnmapFileReal(getpid(),
+                        offset / pageSize,
+                        (offset + length - 1) / pageSize);
+} /* vmUnmapFile */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmUnmapFileReal --
+ *
+ * Called by vmUnmapFile.
+ * Ends the file mapping of the pages from firstPage to lastPage that
+ * have one. Dirty pages of a VM_MAP_SHARED mapping are written back to
+ * their sectors first; everything else, including the swap copies of
+ * a VM_MAP_PRIVATE mapping, is thrown away as with VM_ADVISE_DONTNEED.
+ * The next touch of a page gets a zero filled page. Pages that aren't
+ * mapped are left alone.
+ *
+ * Results:
+ *      OK, or ERROR if a mapped page of the range is pinned or being
+ *      moved by a pager.
+ *
+ * Side effects:
+ *      Disk writes, page table, frame table and track changes.
+ *
+ *----------------------------------------------------------------------
+ */
+static int vmUnmapFileReal(int pid, int firstPage, int lastPage)
+{
+    int frame, access, pagerFrame, pagerZero;
+    PageTableEntryPtr pte;
+    char *buf;
+
+    MboxSend(frameMailbox, NULL, 0);
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    for (int page = firstPage; page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
+
+        if (pte->fileUnit != NOT_MAPPED && (pte->busy == BUSY ||
+                pte->locked == LOCKED ||
+                (pte->frame != PAGE_NOT_IN_FRAME &&
+                 frameTable[pte->frame].pagerOwned == PAGER_OWNED))) {
+            MboxReceive(clockHandMailbox, NULL, 0);
+            MboxReceive(frameMailbox, NULL, 0);
+            return ERROR;
+        }
+    }
+
+    /* readWriteToFrame needs PAGER_PAGE, which may be one of ours */
+    buf = (char *) malloc(pageSize);
+    pte = &pageTable[pid % MAXPROC][PAGER_PAGE];
+    pagerFrame = pte->frame;
+    pagerZero = pte->zeroMapped == ZERO_MAPPED;
+    if (pagerFrame != PAGE_NOT_IN_FRAME || pagerZero) {
+        USLOSS_MmuUnmap(TAG, PAGER_PAGE);
+    }
+
+    /* Write the dirty shared pages back */
+    for (int page = firstPage; page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
+        frame = pte->frame;
+
+        if (pte->fileUnit == NOT_MAPPED || pte->fileMode != VM_MAP_SHARED ||
+                frame == PAGE_NOT_IN_FRAME) {
+            continue;
+        }
+
+        access = 0;
+        if (!EXACT_DIRTY) {
+            USLOSS_MmuGetAccess(frame, &access);
+        }
+        if ((access & DIRTY) != 0 || frameTable[frame].dirty >= DIRTY) {
+            readWriteToFrame(frame, buf, vmRegion);
+            writeFileSectors(pte->fileUnit, pte->fileSector, buf,
+                    "vmUnmapFileReal(): writing mapped file");
+        }
+    }
+
+    if (pagerFrame != PAGE_NOT_IN_FRAME) {
+        USLOSS_MmuMap(TAG, PAGER_PAGE, pagerFrame, pageProtection(pagerFrame));
+    }
+    else if (pagerZero) {
+        USLOSS_MmuMap(TAG, PAGER_PAGE, zeroFrame, USLOSS_MMU_PROT_READ);
+    }
+    free(buf);
+
+    for (int page = firstPage; page <= lastPage; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
+
+        if (pte->fileUnit != NOT_MAPPED) {
+            dropPage(pid, page);
+            pte->fileUnit = NOT_MAPPED;
+            pte->fileSector = NOT_ON_DISK;
+            pte->fileMode = VM_MAP_SHARED;
+        }
+    }
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+    MboxReceive(frameMailbox, NULL, 0);
+
+    return OK;
+} /* vmUnmapFileReal */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmCheckpoint --
+ *
+ * Stub for the VmCheckpoint system call.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      See vmCheckpointReal.
+ *
+ *----------------------------------------------------------------------
+ */
+static void vmCheckpoint(systemArgs *sysargsPtr)
+{
+    CheckMode();
+
+    if (vmStarted != VM_STARTED) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    sysargsPtr->arg4 = (void *) (long) vmCheckpointReal(getpid());
+} /* vmCheckpoint */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmSetPriority --
+ *
+ * Stub for the VmSetPriority system call. arg1 is the scheduling
+ * priority of the calling process. Phase 1 doesn't tell us the
+ * priority of a process, so a process starts at the priority of the
+ * one that forked it (see p1_fork) and may only lower it from there.
+ * Otherwise any process could claim MAXPRIORITY to get ahead in the
+ * fault queue and keep its frames.
+ *
+ * Results:
+ *      None. arg4 is OK, or ERROR if the priority is out of range or
+ *      better than the current one.
+ *
+ * Side effects:
+ *      Faults of the process are queued at this priority.
+ *
+ *----------------------------------------------------------------------
+ */
+static void vmSetPriority(systemArgs *sysargsPtr)
+{
+    CheckMode();
+
+    long priority;
+
+    priority = (long) sysargsPtr->arg1;
+
+    /* Error checking */
+    if (vmStarted != VM_STARTED || priority < MAXPRIORITY ||
+            priority > MINPRIORITY ||
+            priority < processes[getpid() % MAXPROC].priority) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    processes[getpid() % MAXPROC].priority = priority;
+    sysargsPtr->arg4 = (void *) OK;
+} /* vmSetPriority */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmCheckpointReal --
+ *
+ * Called by vmCheckpoint.
+ * Writes every page that is in a frame and dirty (or was never written
+ * out) to its disk block, then writes the page tables' disk blocks and
+ * file mappings to the checkpoint tracks so the next VmInit can resume
+ * from them. The pagers are held off while this runs; pages they are
+ * in the middle of moving are left as they are.
+ *
+ * Results:
+ *      OK, or ERROR if more pages are mapped to files than the image
+ *      has room for.
+ *
+ * Side effects:
+ *      Frames are written to disk and marked clean.
+ *
+ *----------------------------------------------------------------------
+ */
+static int vmCheckpointReal(int pid)
+{
+    int access, dirty, entries, mapped, pageZeroFrame;
+    char *image;
+    CheckpointHeader *header;
+    CheckpointEntry *entry;
+    FrameTableEntryPtr framePtr;
+    PageTableEntryPtr pte;
+
+    MboxSend(frameMailbox, NULL, 0);
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    /* Every track can have an entry, the rest of the room is for the
+     * file mapped pages that have no track */
+    mapped = 0;
+    for (int process = 0; process < MAXPROC; process++) {
+        for (int page = 0; page < numPages; page++) {
+            pte = &pageTable[process][page];
+            if (pte->fileUnit != NOT_MAPPED &&
+                    pte->diskBlock == NOT_ON_DISK) {
+                mapped++;
+            }
+        }
+    }
+
+    if (mapped > checkpointEntries - numTracks) {
+        MboxReceive(clockHandMailbox, NULL, 0);
+        MboxReceive(frameMailbox, NULL, 0);
+        return ERROR;
+    }
+
+    image = (char *) calloc(checkpointTracks, pageSize);
+    invalidateCheckpoint();
+
+    /* The new image replaces the one VmInit found; what nobody claimed
+     * from it is gone */
+    releaseUnclaimed();
+
+    /* readWriteToFrame needs PAGER_PAGE, which may be one of ours */
+    pageZeroFrame = pageTable[pid % MAXPROC][PAGER_PAGE].frame;
+    if (pageZeroFrame != PAGE_NOT_IN_FRAME) {
+        USLOSS_MmuUnmap(TAG, PAGER_PAGE);
+    }
+
+    /* Flush the frames, using the checkpoint image as the buffer */
+    for (int frame = 0; frame < numFrames; frame++) {
+        framePtr = &frameTable[frame];
+
+        /* Frames of a process that quit go with its page table */
+        if (framePtr->used != USED || framePtr->pagerOwned == PAGER_OWNED ||
+                ownerTable(framePtr->pid) !=
+                pageTable[framePtr->pid % MAXPROC]) {
+            continue;
+        }
+
+        pte = &pageTable[framePtr->pid % MAXPROC][framePtr->pageNum];
+        USLOSS_MmuGetAccess(frame, &access);
+
+        dirty = (access & DIRTY) != 0 || framePtr->dirty >= DIRTY;
+        if (!dirty && (pte->diskBlock != NOT_ON_DISK ||
+                        pte->fileUnit != NOT_MAPPED)) {
+            continue;
+        }
+
+        /* Shared file pages are saved in their file, not in the image */
+        if (pte->fileUnit != NOT_MAPPED && pte->fileMode == VM_MAP_SHARED) {
+            readWriteToFrame(frame, image, vmRegion);
+            writeFileSectors(pte->fileUnit, pte->fileSector, image,
+                    "vmCheckpointReal(): writing mapped file");
+        }
+        else {
+            if (pte->diskBlock == NOT_ON_DISK) {
+                pte->diskBlock = findOpenTrack();
+            }
+
+            vmStats.pageOuts++;
+            readWriteToFrame(frame, image, vmRegion);
+            writeTrack(pte->diskBlock, image,
+                    "vmCheckpointReal(): writing to disk");
+        }
+
+        framePtr->dirty = CLEAN;
+        USLOSS_MmuSetAccess(frame, access & ~DIRTY);
+
+        /* Our own pages are mapped, write protect them again */
+        if (EXACT_DIRTY && framePtr->pid == pid &&
+                framePtr->pageNum != PAGER_PAGE) {
+            USLOSS_MmuUnmap(TAG, framePtr->pageNum);
+            USLOSS_MmuMap(TAG, framePtr->pageNum, frame,
+                            USLOSS_MMU_PROT_READ);
+        }
+    }
+
+    if (pageZeroFrame != PAGE_NOT_IN_FRAME) {
+        USLOSS_MmuMap(TAG, PAGER_PAGE, pageZeroFrame,
+                        pageProtection(pageZeroFrame));
+    }
+
+    /* Build the image of every page that has a disk block or a file */
+    memset(image, 0, checkpointTracks * pageSize);
+    header = (CheckpointHeader *) image;
+    entry = (CheckpointEntry *) (header + 1);
+    entries = 0;
+
+    for (int process = 0; process < MAXPROC; process++) {
+        for (int page = 0; page < numPages; page++) {
+            pte = &pageTable[process][page];
+
+            if (pte->diskBlock == NOT_ON_DISK &&
+                    pte->fileUnit == NOT_MAPPED) {
+                continue;
+            }
+
+            entry[entries].slot = process;
+            entry[entries].page = page;
+            entry[entries].diskBlock = pte->diskBlock;
+            entry[entries].resident = pte->frame != PAGE_NOT_IN_FRAME;
+            entry[entries].fileUnit = pte->fileUnit;
+            entry[entries].fileSector = pte->fileSector;
+            entry[entries].fileMode = pte->fileMode;
+            entries++;
+        }
+    }
+
+    header->magic = CHECKPOINT_MAGIC;
+    header->pages = numPages;
+    header->tracks = numTracks;
+    header->entries = entries;
+    writeCheckpoint(image);
+    checkpointValid = 1;
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+    MboxReceive(frameMailbox, NULL, 0);
+
+    free(image);
+    return OK;
+} /* vmCheckpointReal */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmLoadCheckpoint --
+ *
+ * Called by vmInitReal.
+ * Reads the checkpoint image and, if it was written for a disk and
+ * VM region of this size, keeps its entries for the processes to claim
+ * with VmResume. The disk blocks they point at are reserved until then.
+ * The image on disk stays valid until the first swap write, so a
+ * restart before that can resume from it again.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      resumeEntries and tracksInUse are filled in.
+ *
+ *----------------------------------------------------------------------
+ */
+static void vmLoadCheckpoint(void)
+{
+    char *image;
+    CheckpointHeader *header;
+    CheckpointEntry *entry;
+    char *blockUsed;
+
+    resumeEntries = NULL;
+    resumeCount = 0;
+
+    image = (char *) malloc(checkpointTracks * pageSize);
+
+    for (int track = 0; track < checkpointTracks; track++) {
+        readTrack(checkpointTrack + track, image + track * pageSize,
+                "vmLoadCheckpoint(): reading from disk");
+    }
+
+    header = (CheckpointHeader *) image;
+    entry = (CheckpointEntry *) (header + 1);
+
+    if (header->magic != CHECKPOINT_MAGIC || header->pages != numPages ||
+            header->tracks != numTracks || header->entries < 0 ||
+            header->entries > checkpointEntries) {
+        free(image);
+        return;
+    }
+
+    /* One bad entry and none of the image can be trusted */
+    blockUsed = (char *) calloc(numTracks, sizeof(char));
+    for (int index = 0; index < header->entries; index++) {
+        if (!checkpointEntryValid(&entry[index], blockUsed)) {
+            free(blockUsed);
+            free(image);
+            return;
+        }
+    }
+    free(blockUsed);
+
+    resumeCount = header->entries;
+    resumeEntries = (CheckpointEntry *) malloc(resumeCount *
+                                                sizeof(CheckpointEntry));
+    memcpy(resumeEntries, entry, resumeCount * sizeof(CheckpointEntry));
+
+    for (int index = 0; index < resumeCount; index++) {
+        if (entry[index].diskBlock != NOT_ON_DISK) {
+            tracksInUse[entry[index].diskBlock] = USED;
+            vmStats.freeDiskBlocks--;
+        }
+    }
+    checkpointValid = 1;
+
+    free(image);
+} /* vmLoadCheckpoint */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * checkpointEntryValid --
+ *
+ * Called by vmLoadCheckpoint.
+ * Checks that an entry read from the checkpoint image names a real
+ * process slot and page, a swap block below the image that no earlier
+ * entry claimed, and a file mapping vmMapFile could have made.
+ *
+ * Results:
+ *      1 if the entry can be resumed from, 0 otherwise.
+ *
+ * Side effects:
+ *      The entry's block is marked in blockUsed.
+ *
+ *----------------------------------------------------------------------
+ */
+static int checkpointEntryValid(CheckpointEntry *entry, char *blockUsed)
+{
+    if (entry->slot < 0 || entry->slot >= MAXPROC ||
+            entry->page < 0 || entry->page >= numPages) {
+        return 0;
+    }
+
+    if (entry->diskBlock != NOT_ON_DISK) {
+        if (entry->diskBlock < 0 || entry->diskBlock >= checkpointTrack ||
+                blockUsed[entry->diskBlock]) {
+            return 0;
+        }
+        blockUsed[entry->diskBlock] = 1;
+    }
+
+    if (entry->fileUnit != NOT_MAPPED) {
+        if (entry->fileUnit < 0 || entry->fileUnit >= USLOSS_DISK_UNITS ||
+                entry->fileUnit == DISK1 || entry->fileSector < 0 ||
+                entry->fileSector + SECTORS_IN_FRAME >
+                    unitSectors[entry->fileUnit] ||
+                (entry->fileMode != VM_MAP_SHARED &&
+                 entry->fileMode != VM_MAP_PRIVATE)) {
+            return 0;
+        }
+    }
+
+    return 1;
+} /* checkpointEntryValid */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmResume --
+ *
+ * Stub for the VmResume system call.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      See vmResumeReal.
+ *
+ *----------------------------------------------------------------------
+ */
+static void vmResume(systemArgs *sysargsPtr)
+{
+    CheckMode();
+
+    if (vmStarted != VM_STARTED) {
+        sysargsPtr->arg4 = (void *) ERROR;
+        return;
+    }
+
+    sysargsPtr->arg4 = (void *) (long) vmResumeReal(getpid());
+} /* vmResume */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmResumeReal --
+ *
+ * Called by vmResume.
+ * Adopts the checkpoint entries of the slot of pid: its page table is
+ * pointed back at their disk blocks and files, so the pages fault in
+ * from them instead of starting out zero filled. A page the process
+ * has already used keeps what it has, and its entry is released. With
+ * CHECKPOINT_PRELOAD the pages that were in frames are prefetched.
+ *
+ * Results:
+ *      OK, or ERROR if there was nothing to adopt.
+ *
+ * Side effects:
+ *      The page table of pid is filled in.
+ *
+ *----------------------------------------------------------------------
+ */
+static int vmResumeReal(int pid)
+{
+    int slot, adopted;
+    char *preload;
+    CheckpointEntry *entry;
+    PageTableEntryPtr pte;
+
+    slot = pid % MAXPROC;
+    adopted = 0;
+    preload = (char *) calloc(numPages, sizeof(char));
+
+    MboxSend(frameMailbox, NULL, 0);
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    for (int index = 0; index < resumeCount; index++) {
+        entry = &resumeEntries[index];
+        if (entry->slot != slot) {
+            continue;
+        }
+
+        pte = &pageTable[slot][entry->page];
+        if (pte->state != UNREFERENCED || pte->busy == BUSY ||
+                pte->frame != PAGE_NOT_IN_FRAME ||
+                pte->diskBlock != NOT_ON_DISK ||
+                pte->fileUnit != NOT_MAPPED ||
+                pte->zeroMapped == ZERO_MAPPED) {
+            releaseResumeEntry(entry);
+            continue;
+        }
+
+        pte->fileUnit = entry->fileUnit;
+        pte->fileSector = entry->fileSector;
+        pte->fileMode = entry->fileMode;
+        if (entry->diskBlock != NOT_ON_DISK) {
+            pte->state = REFERENCED;
+            pte->diskBlock = entry->diskBlock;
+        }
+        preload[entry->page] = entry->resident;
+        entry->slot = NO_SLOT;
+        adopted++;
+        vmStats.resumed++;
+    }
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+    MboxReceive(frameMailbox, NULL, 0);
+
+    if (CHECKPOINT_PRELOAD) {
+        for (int page = 0; page < numPages; page++) {
+            if (preload[page]) {
+                prefetchPage(pid, page);
+            }
+        }
+    }
+
+    free(preload);
+    return adopted > 0 ? OK : ERROR;
+} /* vmResumeReal */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * writeCheckpoint --
+ *
+ * Writes a checkpoint image to the checkpoint tracks.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Disk writes.
+ *
+ *----------------------------------------------------------------------
+ */
+static void writeCheckpoint(char *image)
+{
+    for (int track = 0; track < checkpointTracks; track++) {
+        writeTrack(checkpointTrack + track, image + track * pageSize,
+                "writeCheckpoint(): writing to disk");
+    }
+} /* writeCheckpoint */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * invalidateCheckpoint --
+ *
+ * Marks the checkpoint image on disk as stale. Called before a swap
+ * track is written, since the image no longer describes the disk
+ * after that.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The first checkpoint track is zeroed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void invalidateCheckpoint(void)
+{
+    char *header;
+
+    if (!checkpointValid) {
+        return;
+    }
+    checkpointValid = 0;
+
+    header = (char *) calloc(1, pageSize);
+    writeTrack(checkpointTrack, header, "invalidateCheckpoint(): writing to disk");
+    free(header);
+} /* invalidateCheckpoint */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrintStats --
+ *
+ *      Print out VM statistics.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      Stuff is printed to the USLOSS_Console.
+ *
+ *----------------------------------------------------------------------
+ */
+void PrintStats(void)
+{
+    USLOSS_Console("VmStats\n");
+    USLOSS_Console("pages:          %d\n", vmStats.pages);
+    USLOSS_Console("frames:         %d\n", vmStats.frames);
+    USLOSS_Console("diskBlocks:     %d\n", vmStats.diskBlocks);
+    USLOSS_Console("freeFrames:     %d\n", vmStats.freeFrames);
+    USLOSS_Console("freeDiskBlocks: %d\n", vmStats.freeDiskBlocks);
+    USLOSS_Console("switches:       %d\n", vmStats.switches);
+    USLOSS_Console("faults:         %d\n", vmStats.faults);
+    USLOSS_Console("new:            %d\n", vmStats.new);
+    USLOSS_Console("pageIns:        %d\n", vmStats.pageIns);
+    USLOSS_Console("pageOuts:       %d\n", vmStats.pageOuts);
+    USLOSS_Console("replaced:       %d\n", vmStats.replaced);
+    USLOSS_Console("lockedFrames:   %d\n", vmStats.lockedFrames);
+    USLOSS_Console("prefetched:     %d\n", vmStats.prefetched);
+    USLOSS_Console("resumed:        %d\n", vmStats.resumed);
+    USLOSS_Console("seeks:          %d\n", vmStats.seeks);
+    if (vmStats.seeks > 0) {
+        USLOSS_Console("avgSeek:        %d.%02d\n",
+                vmStats.seekDistance / vmStats.seeks,
+                (vmStats.seekDistance * 100 / vmStats.seeks) % 100);
+    }
+    USLOSS_Console("queueDepth:    ");
+    for (int depth = 0; depth < QUEUE_DEPTH_BUCKETS; depth++) {
+        USLOSS_Console(" %d", vmStats.queueDepth[depth]);
+    }
+    USLOSS_Console("\n");
+    USLOSS_Console("pagerStarts:    %d\n", vmStats.pagerStarts);
+    USLOSS_Console("pagerExits:     %d\n", vmStats.pagerExits);
+    USLOSS_Console("pagerPeak:      %d\n", vmStats.pagerPeak);
+    USLOSS_Console("promotions:     %d\n", vmStats.promotions);
+    USLOSS_Console("demotions:      %d\n", vmStats.demotions);
+    USLOSS_Console("prepaged:       %d\n", vmStats.prepaged);
+    USLOSS_Console("fileIns:        %d\n", vmStats.fileIns);
+    USLOSS_Console("fileOuts:       %d\n", vmStats.fileOuts);
+    USLOSS_Console("compactMoves:   %d\n", vmStats.compactMoves);
+    USLOSS_Console("zeroMappings:   %d\n", vmStats.zeroMappings);
+    USLOSS_Console("zeroFramesSaved: %d\n", vmStats.zeroFramesSaved);
+    USLOSS_Console("writeFaults:    %d\n", vmStats.writeFaults);
+    USLOSS_Console("pipelined:      %d\n", vmStats.pipelined);
+    USLOSS_Console("inFlightPeak:   %d\n", vmStats.inFlightPeak);
+    USLOSS_Console("diskQueuePeak:  %d\n", vmStats.diskQueuePeak);
+    for (int compact = 0; compact < 2; compact++) {
+        if (vmStats.pageInSeeks[compact] > 0) {
+            USLOSS_Console("%s %d.%02d avg seek per page-in\n",
+                    compact ? "compacted swap: " : "fragmented swap:",
+                    vmStats.pageInSeekDistance[compact] /
+                    vmStats.pageInSeeks[compact],
+                    (vmStats.pageInSeekDistance[compact] * 100 /
+                     vmStats.pageInSeeks[compact]) % 100);
+        }
+    }
+
+    for (int priority = MAXPRIORITY; priority <= MINPRIORITY; priority++) {
+        if (vmStats.priorityFaults[priority] > 0) {
+            USLOSS_Console("priority %d:     %d faults, %d us avg wait\n",
+                    priority, vmStats.priorityFaults[priority],
+                    vmStats.priorityLatency[priority] /
+                    vmStats.priorityFaults[priority]);
+        }
+    }
+} /* PrintStats */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FaultHandler
+ *
+ * Handles an MMU interrupt. A read of a page that was never written
+ * is given the zero frame, read-only. Otherwise simply stores
+ * information about the fault in a queue, wakes a waiting pager, and
+ * blocks until the fault has been handled. Writing to a read-only
+ * page causes an access fault, see writeFault.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * The current process is blocked until the fault is handled.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FaultHandler(int  type /* USLOSS_MMU_INT */,
+             void *arg  /* Offset within VM region */)
+{
+    int cause, pageNum;
+
+    assert(type == USLOSS_MMU_INT);
+    cause = USLOSS_MmuGetCause();
+    assert(cause == USLOSS_MMU_FAULT || cause == USLOSS_MMU_ACCESS);
+    vmStats.faults++;
+    pageNum = (long) arg / pageSize;
+
+    /* The MMU doesn't tell us if this is a read, so every first touch
+     * gets the zero frame and a write comes back as an access fault */
+    if (cause == USLOSS_MMU_FAULT && mapZeroPage(getpid(), pageNum)) {
+        return;
+    }
+
+    if (cause == USLOSS_MMU_ACCESS && writeFault(getpid(), pageNum)) {
+        return;
+    }
+
+    requestPage(getpid(), (long) arg);
+
+    /* Pages of the working set we lost while switched out are brought
+     * back in the background while we run */
+    if (processes[getpid() % MAXPROC].prepage > 0) {
+        prepageWorkingSet(getpid());
+    }
+} /* FaultHandler */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * mapZeroPage
+ *
+ * Called on a fault on page pageNum of process pid. If the page has
+ * never been written, maps it read-only to the zero frame instead of
+ * handing it to a pager. A write to it then ends up in
+ * writeFault.
+ *
+ * Results:
+ * 1 if the page was mapped to the zero frame, 0 if it needs a pager.
+ *
+ * Side effects:
+ * The page is mapped in the MMU
+ *
+ *----------------------------------------------------------------------
+ */
+static int mapZeroPage(int pid, int pageNum)
+{
+    int zero;
+    PageTableEntryPtr pte;
+
+    if (zeroFrame == PAGE_NOT_IN_FRAME) {
+        return 0;
+    }
+
+    MboxSend(frameMailbox, NULL, 0);
+    pte = &pageTable[pid % MAXPROC][pageNum];
+    zero = pte->frame == PAGE_NOT_IN_FRAME && pte->busy == NOT_BUSY &&
+            pte->zeroMapped == NOT_ZERO_MAPPED &&
+            pte->state == UNREFERENCED && pte->diskBlock == NOT_ON_DISK &&
+            pte->fileUnit == NOT_MAPPED;
+    if (zero) {
+        pte->zeroMapped = ZERO_MAPPED;
+        processes[pid % MAXPROC].zeroPages++;
+        vmStats.zeroMappings++;
+        vmStats.zeroFramesSaved++;
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+
+    if (zero) {
+        USLOSS_MmuMap(TAG, pageNum, zeroFrame, USLOSS_MMU_PROT_READ);
+    }
+
+    return zero;
+} /* mapZeroPage */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * writeFault
+ *
+ * Called on a write to a read-only page of process pid. A page mapped
+ * to the zero frame is unmapped so that it gets a frame of its own.
+ * With EXACT_DIRTY a page in a frame is mapped read-only until it is
+ * first written; this is where its frame is marked dirty. Either way
+ * the page is mapped read-write to its frame if it has one, unless a
+ * pager is replacing it.
+ *
+ * Results:
+ * 1 if the page is mapped to its own frame, 0 if it needs a pager.
+ *
+ * Side effects:
+ * The page is unmapped, or remapped, in the MMU
+ *
+ *----------------------------------------------------------------------
+ */
+static int writeFault(int pid, int pageNum)
+{
+    int frame;
+    PageTableEntryPtr pte;
+
+    MboxSend(frameMailbox, NULL, 0);
+    pte = &pageTable[pid % MAXPROC][pageNum];
+    leaveZeroPage(pid, pte);
+    frame = pte->frame;
+    if (frame != PAGE_NOT_IN_FRAME &&
+            frameTable[frame].pagerOwned == PAGER_OWNED) {
+        frame = PAGE_NOT_IN_FRAME;
+    }
+    if (frame != PAGE_NOT_IN_FRAME) {
+        frameTable[frame].dirty = DIRTY;
+        vmStats.writeFaults++;
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+
+    USLOSS_MmuUnmap(TAG, pageNum);
+    if (frame != PAGE_NOT_IN_FRAME) {
+        USLOSS_MmuMap(TAG, pageNum, frame, USLOSS_MMU_PROT_RW);
+        return 1;
+    }
+
+    return 0;
+} /* writeFault */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * requestPage
+ *
+ * Hands the page at offset of process pid to a pager and blocks until
+ * the pager has put it in a frame.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * The current process is blocked until the page is in a frame.
+ *
+ *----------------------------------------------------------------------
+ */
+static void requestPage(int pid, int offset)
+{
+    FaultMsgPtr faultMsg;
+
+    faultMsg = &faults[pid % MAXPROC];
+    faultMsg->pid = pid;
+    faultMsg->offset = offset;
+    faultMsg->priority = processes[pid % MAXPROC].priority;
+    gettimeofdayReal(&faultMsg->queued);
+
+    MboxSend(pagersMailbox, (void *) faultMsg, sizeof(FaultMsg));
+    MboxReceive(faultMsg->replyMbox, NULL, 0);
+} /* requestPage */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * prefetchPage
+ *
+ * Asks a pager to bring in page pageNum of process pid without waiting
+ * for it. Pages that are already in a frame or on their way in are
+ * skipped, and so is the request if the pagers are backed up.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * A fault message may be queued for the pagers.
+ *
+ *----------------------------------------------------------------------
+ */
+static void prefetchPage(int pid, int pageNum)
+{
+    FaultMsg faultMsg;
+    PageTableEntryPtr pte;
+
+    pte = &pageTable[pid % MAXPROC][pageNum];
+    if (pte->frame != PAGE_NOT_IN_FRAME || pte->busy == BUSY) {
+        return;
+    }
+
+    faultMsg.pid = pid;
+    faultMsg.offset = pageNum * pageSize;
+    faultMsg.replyMbox = NO_REPLY;
+    faultMsg.priority = PREFETCH_PRIORITY;
+    gettimeofdayReal(&faultMsg.queued);
+
+    MboxCondSend(pagersMailbox, (void *) &faultMsg, sizeof(FaultMsg));
+} /* prefetchPage */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * prepageWorkingSet
+ *
+ * Asks the pagers to bring back, without waiting for them, up to
+ * PREPAGE_LIMIT of the pages process pid referenced the last time it
+ * ran that p1_switch found out of their frames when it switched the
+ * process in.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Fault messages may be queued for the pagers.
+ *
+ *----------------------------------------------------------------------
+ */
+static void prepageWorkingSet(int pid)
+{
+    int queued;
+    PageTableEntryPtr pte;
+
+    processes[pid % MAXPROC].prepage = 0;
+    queued = 0;
+
+    for (int page = 0; page < numPages && queued < PREPAGE_LIMIT; page++) {
+        pte = &pageTable[pid % MAXPROC][page];
+
+        if (pte->workingSet == IN_WORKING_SET &&
+                pte->frame == PAGE_NOT_IN_FRAME && pte->busy == NOT_BUSY) {
+            pte->workingSet = NOT_IN_WORKING_SET;
+            prefetchPage(pid, page);
+            queued++;
+        }
+    }
+
+    vmStats.prepaged += queued;
+} /* prepageWorkingSet */
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * clockAlgorithm
+ *
+ * Picks the frame to bring a page into for a process at the given
+ * priority. During the first two turns of the clock, frames of
+ * processes with a better priority are passed over so that their
+ * pages are replaced last. Pages of a VM_ADVISE_SEQUENTIAL range that
+ * the process's faults have gone past are taken even when referenced.
+ *
+ * Results:
+ * Returns the index of the next frame to use
+ *
+ * Side effects:
+ * Increments the clockHand
+ *
+ *----------------------------------------------------------------------
+ */
+static int clockAlgorithm(int priority) {
+    FrameTableEntryPtr curFrame;
+    int frameToReturn, steps, access, behind;
+
+    frameToReturn = 0;
+    steps = 0;
+
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    /* Look for an unused frame */
+    for (int frame = 0; frame < numFrames; frame++) {
+        curFrame = &frameTable[frame];
+
+        if (curFrame->used == NOT_USED &&
+            curFrame->pagerOwned == NOT_PAGER_OWNED) {
+            setFrameEntryMembers(curFrame->pid, frame, UNREFERENCED, curFrame->dirty, curFrame->pageNum, NOT_USED, PAGER_OWNED);
+            vmStats.freeFrames--;
+            MboxReceive(clockHandMailbox, NULL, 0);
+            return frame;
+        }
+    }
+
+    /* Now using the clock hand look for the first unreferenced frame */
+
+    while (1) {
+        curFrame = &frameTable[clockHand];
+
+        /* With EXACT_DIRTY p1_switch doesn't harvest the reference bits,
+         * so read the bit here; it is the only up to date one for the
+         * frames of the running process anyway */
+        if (EXACT_DIRTY && curFrame->used == USED &&
+                curFrame->pagerOwned == NOT_PAGER_OWNED) {
+            USLOSS_MmuGetAccess(clockHand, &access);
+            if (access & REFERENCED) {
+                curFrame->state = REFERENCED;
+            }
+        }
+
+        /* A page advised sequential that the scan has gone past won't
+         * be used again, referenced or not. Pages at or ahead of the
+         * scan, like the ones just read ahead, keep their reference bit */
+        behind = curFrame->used == USED &&
+                pageTable[curFrame->pid % MAXPROC][curFrame->pageNum].advice
+                    == VM_ADVISE_SEQUENTIAL &&
+                curFrame->pageNum <
+                    processes[curFrame->pid % MAXPROC].scanPage;
+
+        /* If the state is unreferenced (or the page is behind a
+         * sequential scan) and not pager owned or locked take the frame */
+        if ((curFrame->state == UNREFERENCED || behind) &&
+                curFrame->pagerOwned == NOT_PAGER_OWNED &&
+                curFrame->locked == UNLOCKED &&
+                (steps >= 2 * numFrames || curFrame->used == NOT_USED ||
+                 processes[curFrame->pid % MAXPROC].priority >= priority)) {
+            setFrameEntryMembers(curFrame->pid, clockHand, curFrame->state, curFrame->dirty, curFrame->pageNum, curFrame->used, PAGER_OWNED);
+            frameToReturn = clockHand;
+            clockHand = (clockHand+1) % numFrames;
+            break;
+        }
+
+        if (curFrame->pagerOwned != PAGER_OWNED) {
+            USLOSS_MmuSetAccess(clockHand, (0 | curFrame->dirty));
+            curFrame->state = UNREFERENCED;            
+        }
+
+        clockHand = (clockHand+1) % numFrames;
+        steps++;
+    }
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+
+    return frameToReturn;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * claimFrameRun
+ *
+ * Finds CLUSTER_PAGES frames in a row, starting at a multiple of
+ * CLUSTER_PAGES, for a cluster of a process at the given priority.
+ * A run of free frames is taken first; otherwise the first run past
+ * the clock hand whose frames could all be replaced by clockAlgorithm.
+ * Reference bits are left alone, so this gives up rather than wait
+ * for the clock to come around.
+ *
+ * Results:
+ * Returns the first frame of the run, or PAGE_NOT_IN_FRAME if there
+ * is no such run.
+ *
+ * Side effects:
+ * The frames of the run become pager owned, the clockHand moves past
+ * the run.
+ *
+ *----------------------------------------------------------------------
+ */
+static int claimFrameRun(int priority)
+{
+    FrameTableEntryPtr curFrame;
+    int runs, run, usable;
+
+    runs = numFrames / CLUSTER_PAGES;
+
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    for (int step = 0; step < 2 * runs; step++) {
+        /* Free runs on the first pass, then runs we can replace */
+        if (step < runs) {
+            run = step * CLUSTER_PAGES;
+        }
+        else {
+            run = ((clockHand / CLUSTER_PAGES + step) % runs) * CLUSTER_PAGES;
+        }
+        usable = 1;
+
+        for (int frame = run; usable && frame < run + CLUSTER_PAGES;
+                frame++) {
+            curFrame = &frameTable[frame];
+
+            if (curFrame->pagerOwned == PAGER_OWNED ||
+                    curFrame->locked == LOCKED) {
+                usable = 0;
+            }
+            else if (step < runs) {
+                usable = curFrame->used == NOT_USED;
+            }
+            else {
+                usable = curFrame->used == NOT_USED ||
+                    (curFrame->state == UNREFERENCED &&
+                     processes[curFrame->pid % MAXPROC].priority >= priority);
+            }
+        }
+
+        if (usable) {
+            for (int frame = run; frame < run + CLUSTER_PAGES; frame++) {
+                if (frameTable[frame].used == NOT_USED) {
+                    vmStats.freeFrames--;
+                }
+                frameTable[frame].pagerOwned = PAGER_OWNED;
+            }
+            clockHand = (run + CLUSTER_PAGES) % numFrames;
+
+            MboxReceive(clockHandMailbox, NULL, 0);
+            return run;
+        }
+    }
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+
+    return PAGE_NOT_IN_FRAME;
+} /* claimFrameRun */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Pager 
+ *
+ * Kernel process that handles page faults and does page replacement.
+ *
+ * Results:
+ * Maps a page to a frame
+ *
+ * Side effects:
+ * Changes to the mmu, frameTable, and pageTable
+ *
+ *----------------------------------------------------------------------
+ */
+static int Pager(char *buf)
+{
+    int mailboxStatus, haveFault, moreFaults, index, now, oldest, request;
+    FaultMsg faultMsg, kick;
+
+    /* Allocate memory for the buffer */
+    buf = (char *) malloc(sizeof(char) * pageSize);
+    kick.pid = NO_PID;
+
+    while(1) {
+        /* Block for a fault only when there is nothing queued. Faults
+         * still in pagersMailbox count, so compaction never makes them
+         * wait for more than the page it is moving. */
+        MboxSend(faultQueueMailbox, NULL, 0);
+        drainFaults();
+        haveFault = faultQueueCount > 0;
+        MboxReceive(faultQueueMailbox, NULL, 0);
+
+        /* While the disk is idle, tidy up the swap disk a page at a time */
+        if (!haveFault && SWAP_COMPACTION && compactSwap(buf)) {
+            continue;
+        }
+
+        if (!haveFault) {
+            mailboxStatus = MboxReceive(pagersMailbox, (void *) &faultMsg,
+                                        sizeof(FaultMsg));
+            if (mailboxStatus == MAILBOX_RELEASED) {
+                free(buf);
+                return 0;
+            }
+        }
+
+        /* Queue every pending fault and take the best one */
+        MboxSend(faultQueueMailbox, NULL, 0);
+        if (!haveFault && faultMsg.pid != NO_PID) {
+            faultQueue[faultQueueCount++] = faultMsg;
+        }
+        drainFaults();
+
+        /* Ask for another pager if faults are piling up */
+        gettimeofdayReal(&now);
+        oldest = now;
+        for (index = 0; index < faultQueueCount; index++) {
+            if (faultQueue[index].queued < oldest) {
+                oldest = faultQueue[index].queued;
+            }
+        }
+
+        if (faultQueueCount > 1) {
+            faultQueueBusy = now;
+        }
+
+        request = 0;
+        if (!poolGrowing && numPagers < pagerLimit &&
+                numPagers < replaceableFrames() &&
+                (faultQueueCount > POOL_GROW_DEPTH * numPagers ||
+                 now - oldest > POOL_GROW_WAIT)) {
+            poolGrowing = 1;
+            request = POOL_GROW;
+        }
+
+        haveFault = faultQueueCount > 0;
+        if (haveFault) {
+            vmStats.queueDepth[faultQueueCount < QUEUE_DEPTH_BUCKETS ?
+                    faultQueueCount - 1 : QUEUE_DEPTH_BUCKETS - 1]++;
+
+            index = nextFault();
+            faultMsg = faultQueue[index];
+            faultQueue[index] = faultQueue[--faultQueueCount];
+            busyPagers++;
+        }
+        moreFaults = faultQueueCount > 0;
+        MboxReceive(faultQueueMailbox, NULL, 0);
+
+        /* Wake an idle pager to help with what is left */
+        if (moreFaults) {
+            MboxCondSend(pagersMailbox, (void *) &kick, sizeof(FaultMsg));
+        }
+
+        if (request == POOL_GROW) {
+            MboxCondSend(poolMailbox, (void *) &request, sizeof(int));
+        }
+
+        if (haveFault) {
+            servicePage(&faultMsg, buf);
+        }
+
+        /* Leave the pool if we have had nothing to share for a while */
+        gettimeofdayReal(&now);
+        MboxSend(faultQueueMailbox, NULL, 0);
+        if (haveFault) {
+            busyPagers--;
+        }
+        request = 0;
+        if (faultQueueCount == 0 && numPagers - pagersLeaving > minPagers &&
+                now - faultQueueBusy > POOL_IDLE) {
+            pagersLeaving++;
+            request = POOL_SHRINK;
+        }
+        MboxReceive(faultQueueMailbox, NULL, 0);
+
+        if (request == POOL_SHRINK) {
+            MboxSend(poolMailbox, (void *) &request, sizeof(int));
+            free(buf);
+            return 0;
+        }
+    }
+    return 0;
+} /* Pager */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PagerPool
+ *
+ * Kernel process that owns the pagers. It starts minPagers of them,
+ * adds one on a POOL_GROW request (up to pagerLimit, and only while
+ * every pager has a frame it can replace) and joins a pager
+ * that sends POOL_SHRINK before it quits. When vmDestroyReal releases
+ * the pool mailbox, it joins the pagers that are left.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Pagers are forked and joined
+ *
+ *----------------------------------------------------------------------
+ */
+static int PagerPool(char *arg)
+{
+    int request, joinStatus, units;
+    char name[20];
+
+    units = 0;
+    request = POOL_GROW;
+
+    while (1) {
+        if (request == POOL_GROW && numPagers < pagerLimit &&
+                (units < minPagers || numPagers < replaceableFrames())) {
+            sprintf(name, "Pager unit %d", units++);
+            numPagers++;
+            fork1(name, Pager, NULL, USLOSS_MIN_STACK, PAGER_PRIORITY);
+
+            if (numPagers > vmStats.pagerPeak) {
+                vmStats.pagerPeak = numPagers;
+            }
+            if (units > minPagers) {
+                vmStats.pagerStarts++;
+            }
+        }
+        else if (request == POOL_SHRINK) {
+            join(&joinStatus);
+            numPagers--;
+            pagersLeaving--;
+            vmStats.pagerExits++;
+        }
+
+        /* Start the pagers VmInit asked for before taking requests */
+        if (units < minPagers) {
+            request = POOL_GROW;
+            continue;
+        }
+        poolGrowing = 0;
+
+        if (MboxReceive(poolMailbox, (void *) &request,
+                        sizeof(int)) == MAILBOX_RELEASED) {
+            break;
+        }
+    }
+
+    while (numPagers > 0) {
+        join(&joinStatus);
+        numPagers--;
+    }
+
+    return 0;
+} /* PagerPool */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PoolTimer
+ *
+ * Kernel process that wakes every POOL_TICK seconds. A pager only
+ * checks whether it has been idle long enough to leave the pool when
+ * it wakes up, so while the fault queue has been quiet for POOL_IDLE
+ * the timer sends a NO_PID kick for every pager above the VmInit count.
+ * A woken pager finds no fault and goes straight to that check.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Pagers are woken
+ *
+ *----------------------------------------------------------------------
+ */
+static int PoolTimer(char *arg)
+{
+    int now, kicks;
+    FaultMsg kick;
+
+    kick.pid = NO_PID;
+
+    while (1) {
+        sleepReal(POOL_TICK);
+        if (!poolTicking) {
+            break;
+        }
+
+        gettimeofdayReal(&now);
+        MboxSend(faultQueueMailbox, NULL, 0);
+        kicks = 0;
+        if (faultQueueCount == 0 && now - faultQueueBusy > POOL_IDLE) {
+            kicks = numPagers - pagersLeaving - minPagers;
+        }
+        MboxReceive(faultQueueMailbox, NULL, 0);
+
+        for (; kicks > 0; kicks--) {
+            MboxCondSend(pagersMailbox, (void *) &kick, sizeof(FaultMsg));
+        }
+    }
+
+    return 0;
+} /* PoolTimer */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * poolLimit
+ *
+ * Every pager needs a frame to work with and takes a process table
+ * entry, so the pool is kept to one pager per frame and to
+ * POOL_MAX_PAGERS.
+ *
+ * Results:
+ * The most pagers the pool may have with frames frames.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+int poolLimit(int frames)
+{
+    return frames < POOL_MAX_PAGERS ? frames : POOL_MAX_PAGERS;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * replaceableFrames
+ *
+ * Counts the frames the clock algorithm can hand to a pager, which are
+ * all of them but the pinned ones and the zero frame.
+ *
+ * Results:
+ * The number of frames that aren't locked.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+int replaceableFrames(void)
+{
+    int frames;
+
+    frames = numFrames - vmStats.lockedFrames;
+    if (zeroFrame != PAGE_NOT_IN_FRAME) {
+        frames--;
+    }
+
+    return frames;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * drainFaults
+ *
+ * Moves every fault waiting in pagersMailbox to the fault queue.
+ * Messages with pid NO_PID only wake a pager and are dropped. Must be
+ * called holding faultQueueMailbox.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * faultQueue grows
+ *
+ *----------------------------------------------------------------------
+ */
+static void drainFaults(void)
+{
+    FaultMsg faultMsg;
+
+    while (faultQueueCount < FAULT_QUEUE_SIZE &&
+            MboxCondReceive(pagersMailbox, (void *) &faultMsg,
+                            sizeof(FaultMsg)) >= 0) {
+        if (faultMsg.pid != NO_PID) {
+            faultQueue[faultQueueCount++] = faultMsg;
+        }
+    }
+} /* drainFaults */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * nextFault
+ *
+ * Picks the queued fault to service next. Only the faults with the
+ * best priority are looked at, where a fault gains a level for every
+ * FAULT_AGING it has been waiting. Of those, faults that don't need a
+ * page read go first since they don't move the disk head. The rest are
+ * taken in SCAN order: the closest track in the direction the head is
+ * moving, turning around at the last one. Must be called holding
+ * faultQueueMailbox with a non-empty queue.
+ *
+ * Results:
+ * Index into faultQueue
+ *
+ * Side effects:
+ * scanDirection may change
+ *
+ *----------------------------------------------------------------------
+ */
+static int nextFault(void)
+{
+    int best, bestDistance, distance, track, now, bestPriority, found;
+    int priority[FAULT_QUEUE_SIZE];
+    PageTableEntryPtr pte;
+
+    /* Age the faults and find the best priority */
+    gettimeofdayReal(&now);
+    bestPriority = PREFETCH_PRIORITY;
+
+    for (int index = 0; index < faultQueueCount; index++) {
+        priority[index] = faultQueue[index].priority -
+                            (now - faultQueue[index].queued) / FAULT_AGING;
+        if (priority[index] < MAXPRIORITY) {
+            priority[index] = MAXPRIORITY;
+        }
+        if (priority[index] < bestPriority) {
+            bestPriority = priority[index];
+        }
+    }
+
+    /* The disk workers move the head too */
+    found = -1;
+    MboxSend(diskMailbox, NULL, 0);
+    for (int turn = 0; found == -1 && turn < 2; turn++) {
+        best = -1;
+        bestDistance = numTracks;
+
+        for (int index = 0; found == -1 && index < faultQueueCount;
+                index++) {
+            if (priority[index] != bestPriority) {
+                continue;
+            }
+
+            pte = &pageTable[faultQueue[index].pid % MAXPROC]
+                            [faultQueue[index].offset / pageSize];
+            track = pte->diskBlock;
+
+            if (track == NOT_ON_DISK || pte->frame != PAGE_NOT_IN_FRAME ||
+                    pte->busy == BUSY) {
+                found = index;
+                continue;
+            }
+
+            distance = (track - diskHead) * scanDirection;
+            if (distance >= 0 && distance < bestDistance) {
+                best = index;
+                bestDistance = distance;
+            }
+        }
+
+        if (found == -1 && best != -1) {
+            found = best;
+        }
+        else if (found == -1) {
+            scanDirection = -scanDirection;
+        }
+    }
+    MboxReceive(diskMailbox, NULL, 0);
+
+    if (found != -1) {
+        return found;
+    }
+
+    for (int index = 0; index < faultQueueCount; index++) {
+        if (priority[index] == bestPriority) {
+            return index;
+        }
+    }
+    return 0;
+} /* nextFault */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * servicePage
+ *
+ * Brings in the page described by faultPtr, replacing a page if no
+ * frame is free. Faults are replied to once the page is in a frame;
+ * prefetches (replyMbox == NO_REPLY) aren't. If another pager is
+ * already bringing the page in, a fault waits on that pager instead.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Changes to the mmu, frameTable, and pageTable
+ *
+ *----------------------------------------------------------------------
+ */
+static void servicePage(FaultMsgPtr faultPtr, char *buf)
+{
+    int pid, frameIndex, pageNum, replyNow, priority;
+    FrameTableEntryPtr frameToUse;
+    PageTableEntryPtr table, pageToLoad;
+
+    pid = faultPtr->pid;
+
+    /* Prefetches queue below every process, but take frames like a
+     * MINPRIORITY process; otherwise every one would sweep the clock
+     * twice before it could replace anything */
+    priority = faultPtr->priority;
+    if (priority > MINPRIORITY) {
+        priority = MINPRIORITY;
+    }
+
+    /* Find the page number based on the addr the fault happened */
+    pageNum = faultPtr->offset / pageSize;
+
+    /* Claim the page, unless it is already in or on its way in */
+    MboxSend(frameMailbox, NULL, 0);
+    table = pageTable[pid % MAXPROC];
+    pageToLoad = &table[pageNum];
+
+    /* A fault moves the sequential scan on, read-ahead doesn't */
+    if (faultPtr->replyMbox != NO_REPLY &&
+            pageToLoad->advice == VM_ADVISE_SEQUENTIAL) {
+        processes[pid % MAXPROC].scanPage = pageNum;
+    }
+
+    if (pageToLoad->frame != PAGE_NOT_IN_FRAME || pageToLoad->busy == BUSY) {
+        replyNow = NO_REPLY;
+
+        if (pageToLoad->busy == BUSY) {
+            if (faultPtr->replyMbox != NO_REPLY) {
+                pageToLoad->waiter = faultPtr->replyMbox;
+            }
+        }
+        else {
+            replyNow = faultPtr->replyMbox;
+        }
+        MboxReceive(frameMailbox, NULL, 0);
+
+        if (replyNow != NO_REPLY) {
+            faultLatency(faultPtr);
+            MboxSend(replyNow, NULL, 0);
+        }
+        return;
+    }
+
+    /* Bring the page's whole group in as a cluster if we can */
+    if (CLUSTER_PAGES > 1) {
+        frameIndex = claimCluster(table, pageNum, priority);
+        if (frameIndex != PAGE_NOT_IN_FRAME) {
+            MboxReceive(frameMailbox, NULL, 0);
+            serviceCluster(faultPtr, table, frameIndex, buf);
+            return;
+        }
+    }
+    pageToLoad->busy = BUSY;
+    MboxReceive(frameMailbox, NULL, 0);
+
+    /* Find frame to use with clockAlgorithm */  
+    frameIndex = clockAlgorithm(priority);
+    frameToUse = &frameTable[frameIndex];
+
+    /* Let the disk workers do the I/O while we go on to the next fault */
+    if (DISK_WORKERS > 0) {
+        startFault(faultPtr, table, frameIndex);
+        return;
+    }
+
+    /* Update the page table of the process that owns the frame */
+    if (frameToUse->used == USED) {
+        evictFrame(frameIndex, buf);
+    }
+
+    /* Check if we need to read from disk or zero out frame */
+    if (pageToLoad->diskBlock != NOT_ON_DISK) {
+        /* Copy page from disk into buffer then into frame */
+        vmStats.pageIns++;
+        readPageIn(pageToLoad->diskBlock, buf, "Pager(): reading from disk");
+        readWriteToFrame(frameIndex, vmRegion, buf);
+    }
+    else if (pageToLoad->fileUnit != NOT_MAPPED) {
+        readFileSectors(pageToLoad->fileUnit, pageToLoad->fileSector, buf,
+                        "Pager(): reading mapped file");
+        readWriteToFrame(frameIndex, vmRegion, buf);
+    }
+    else {
+        memset(buf, 0, pageSize);
+        readWriteToFrame(frameIndex, vmRegion, buf);
+    }
+
+    installPage(faultPtr, table, frameIndex);
+} /* servicePage */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * installPage
+ *
+ * Puts the page of faultPtr, whose contents are already in frameIndex,
+ * in the page table and replies to the fault and to any fault that
+ * waited on the page. If the process quit meanwhile the frame is given
+ * back instead.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Changes to the mmu, frameTable, and pageTable
+ *
+ *----------------------------------------------------------------------
+ */
+static void installPage(FaultMsgPtr faultPtr, PageTableEntryPtr table,
+                            int frameIndex)
+{
+    int pid, pageNum, waiter;
+    PageTableEntryPtr pageToLoad;
+
+    pid = faultPtr->pid;
+    pageNum = faultPtr->offset / pageSize;
+    pageToLoad = &table[pageNum];
+
+    MboxSend(frameMailbox, NULL, 0);
+
+    /* If the process quit while we were at it, give the frame back and
+     * the page to the reclaim of its page table */
+    if (pageTable[pid % MAXPROC] != table) {
+        setFrameEntryMembers(NO_PID, frameIndex, UNREFERENCED, CLEAN,
+                                PAGE_NOT_IN_FRAME, NOT_USED, NOT_PAGER_OWNED);
+        vmStats.freeFrames++;
+        releaseQuitPage(table, pageNum);
+        MboxReceive(frameMailbox, NULL, 0);
+        return;
+    }
+
+    /* Set members inside frame entry and process page table */
+    if (pageToLoad->state == UNREFERENCED) {
+        vmStats.new++;
+    }
+
+    setFrameEntryMembers(pid, frameIndex, UNREFERENCED, CLEAN, pageNum, USED, NOT_PAGER_OWNED);
+    setPageEntryMembers(pid, pageNum, REFERENCED, frameIndex,
+                        pageToLoad->diskBlock);
+    leaveZeroPage(pid, pageToLoad);
+    if (faultPtr->replyMbox != NO_REPLY) {
+        pageToLoad->workingSet = IN_WORKING_SET;
+    }
+    processes[pid % MAXPROC].pagesInUse++;
+    pageToLoad->busy = NOT_BUSY;
+    waiter = pageToLoad->waiter;
+    pageToLoad->waiter = NO_REPLY;
+    MboxReceive(frameMailbox, NULL, 0);
+
+    /* Set access bit */
+    USLOSS_MmuSetAccess(frameIndex, 0);
+
+    if (faultPtr->replyMbox != NO_REPLY) {
+        faultLatency(faultPtr);
+        MboxSend(faultPtr->replyMbox, NULL, 0);
+    }
+    else {
+        vmStats.prefetched++;
+    }
+
+    if (waiter != NO_REPLY) {
+        MboxSend(waiter, NULL, 0);
+    }
+
+    /* Read ahead of a fault in a sequential range */
+    if (faultPtr->replyMbox != NO_REPLY &&
+            pageToLoad->advice == VM_ADVISE_SEQUENTIAL) {
+        for (int ahead = 1; ahead <= READ_AHEAD_PAGES &&
+                pageNum + ahead < numPages; ahead++) {
+            if (pageTable[pid % MAXPROC][pageNum + ahead].advice ==
+                    VM_ADVISE_SEQUENTIAL) {
+                prefetchPage(pid, pageNum + ahead);
+            }
+        }
+    }
+} /* installPage */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * startFault
+ *
+ * The first stage of the fault pipeline, used instead of the rest of
+ * servicePage when there are disk workers. Takes a fault context, gets
+ * the victim out of frameIndex and hands the write-back of the victim
+ * and the page-in of the page to the disk workers. The pager is free
+ * for the next fault as soon as they are queued; the worker finishing
+ * the last of them puts the page in (see finishFault).
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk requests are queued, the context is in flight
+ *
+ *----------------------------------------------------------------------
+ */
+static void startFault(FaultMsgPtr faultPtr, PageTableEntryPtr table,
+                        int frameIndex)
+{
+    int index;
+    FaultContextPtr context;
+    PageTableEntryPtr pageToLoad;
+    IoRequest request;
+
+    /* Wait for a context if MAX_IN_FLIGHT faults are in the pipeline */
+    if (MboxReceive(contextMailbox, (void *) &index,
+                    sizeof(int)) == MAILBOX_RELEASED) {
+        return;
+    }
+
+    context = &contexts[index];
+    context->fault = *faultPtr;
+    context->table = table;
+    context->frame = frameIndex;
+    context->pending = 0;
+    context->victimTable = NULL;
+    pageToLoad = &table[faultPtr->offset / pageSize];
+
+    /* Stage one: the victim leaves the frame */
+    if (frameTable[frameIndex].used == USED) {
+        startWriteBack(context);
+    }
+
+    /* Stage two: where the page comes from */
+    context->inUnit = NOT_MAPPED;
+    if (pageToLoad->diskBlock != NOT_ON_DISK) {
+        vmStats.pageIns++;
+        context->inUnit = DISK1;
+        context->inTrack = pageToLoad->diskBlock;
+        context->pending++;
+    }
+    else if (pageToLoad->fileUnit != NOT_MAPPED) {
+        context->inUnit = pageToLoad->fileUnit;
+        context->inTrack = pageToLoad->fileSector;
+        context->pending++;
+    }
+    else {
+        memset(context->inBuf, 0, pageSize);
+    }
+
+    MboxSend(diskMailbox, NULL, 0);
+    vmStats.pipelined++;
+    inFlight++;
+    if (inFlight > vmStats.inFlightPeak) {
+        vmStats.inFlightPeak = inFlight;
+    }
+    MboxReceive(diskMailbox, NULL, 0);
+
+    /* Nothing to read or write, the page can go in right away */
+    if (context->pending == 0) {
+        finishFault(index);
+        return;
+    }
+
+    request.context = index;
+    if (context->victimTable != NULL) {
+        request.op = IO_WRITE_BACK;
+        queueRequest(&request);
+    }
+    if (context->inUnit != NOT_MAPPED) {
+        request.op = IO_PAGE_IN;
+        queueRequest(&request);
+    }
+} /* startFault */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * startWriteBack
+ *
+ * Takes the page in the frame of context out of it, like evictFrame,
+ * but without waiting for the disk. A dirty page is copied to the
+ * context and stays BUSY until a disk worker has written it, so a
+ * fault on it waits for the write instead of reading a stale track.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Page table of the owner changes, context->pending is incremented if
+ * the page has to be written
+ *
+ *----------------------------------------------------------------------
+ */
+static void startWriteBack(FaultContextPtr context)
+{
+    int pid, page, dirty, toFile, waiter;
+    FrameTableEntryPtr frameToUse;
+    PageTableEntryPtr table, victim;
+
+    frameToUse = &frameTable[context->frame];
+    pid = frameToUse->pid;
+    page = frameToUse->pageNum;
+    vmStats.replaced++;
+
+    MboxSend(frameMailbox, NULL, 0);
+    table = ownerTable(pid);
+    victim = &table[page];
+    if (victim->frame != context->frame) {
+        MboxReceive(frameMailbox, NULL, 0);
+        return;
+    }
+    demoteCluster(table, page);
+
+    dirty = frameToUse->dirty >= DIRTY;
+    toFile = dirty && victim->fileUnit != NOT_MAPPED &&
+                victim->fileMode == VM_MAP_SHARED;
+    if (table != pageTable[pid % MAXPROC]) {
+        dirty = toFile;
+    }
+    if (dirty && !toFile && victim->diskBlock == NOT_ON_DISK) {
+        victim->diskBlock = findOpenTrack();
+    }
+    context->outUnit = toFile ? victim->fileUnit : DISK1;
+    context->outTrack = toFile ? victim->fileSector : victim->diskBlock;
+    MboxReceive(frameMailbox, NULL, 0);
+
+    if (dirty) {
+        if (!toFile) {
+            vmStats.pageOuts++;
+            invalidateCheckpoint();
+        }
+        readWriteToFrame(context->frame, context->outBuf, vmRegion);
+    }
+
+    waiter = NO_REPLY;
+    MboxSend(frameMailbox, NULL, 0);
+    if (table == pageTable[pid % MAXPROC]) {
+        if (EXACT_DIRTY && victim->workingSet == IN_WORKING_SET) {
+            processes[pid % MAXPROC].prepage++;
+        }
+        setPageEntryMembers(pid, page, REFERENCED, PAGE_NOT_IN_FRAME,
+                                victim->diskBlock);
+        processes[pid % MAXPROC].pagesInUse--;
+        waiter = victim->waiter;
+        victim->waiter = NO_REPLY;
+    }
+    else {
+        victim->frame = PAGE_NOT_IN_FRAME;
+    }
+
+    if (dirty) {
+        victim->busy = BUSY;
+        context->victimPid = pid;
+        context->victimPage = page;
+        context->victimTable = table;
+        context->pending++;
+    }
+    else if (table != pageTable[pid % MAXPROC]) {
+        releaseQuitPage(table, page);
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+
+    /* VmLock waits for the page to leave its frame */
+    if (waiter != NO_REPLY) {
+        MboxSend(waiter, NULL, 0);
+    }
+} /* startWriteBack */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DiskWorker
+ *
+ * Kernel process that does the disk requests of the fault pipeline.
+ * There are DISK_WORKERS of them, so that many requests are at the
+ * disk at once. Each takes the queued request nextRequest picks, so
+ * the swap disk is still swept in SCAN order.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk reads and writes
+ *
+ *----------------------------------------------------------------------
+ */
+static int DiskWorker(char *arg)
+{
+    int index;
+    IoRequest request;
+    FaultContextPtr context;
+
+    while (1) {
+        if (MboxReceive(ioMailbox, NULL, 0) == MAILBOX_RELEASED) {
+            return 0;
+        }
+        MboxSend(diskMailbox, NULL, 0);
+        index = nextRequest();
+        request = ioRequests[index];
+        ioRequests[index] = ioRequests[--ioQueued];
+        MboxReceive(diskMailbox, NULL, 0);
+        context = &contexts[request.context];
+
+        if (request.op == IO_WRITE_BACK) {
+            if (context->outUnit == DISK1) {
+                writeTrack(context->outTrack, context->outBuf,
+                            "DiskWorker(): writing to disk");
+            }
+            else {
+                writeFileSectors(context->outUnit, context->outTrack,
+                        context->outBuf, "DiskWorker(): writing mapped file");
+            }
+            writeBackDone(context);
+        }
+        else if (context->inUnit == DISK1) {
+            readPageIn(context->inTrack, context->inBuf,
+                        "DiskWorker(): reading from disk");
+        }
+        else {
+            readFileSectors(context->inUnit, context->inTrack, context->inBuf,
+                            "DiskWorker(): reading mapped file");
+        }
+
+        /* The last request of the fault puts the page in */
+        MboxSend(frameMailbox, NULL, 0);
+        context->pending--;
+        if (context->pending == 0) {
+            MboxReceive(frameMailbox, NULL, 0);
+            finishFault(request.context);
+        }
+        else {
+            MboxReceive(frameMailbox, NULL, 0);
+        }
+    }
+    return 0;
+} /* DiskWorker */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * writeBackDone
+ *
+ * Called once the page written back for context is on disk. The page
+ * stops being BUSY, and a fault that waited on it faults again and
+ * reads it in. If its process quit meanwhile, the page goes to the
+ * reclaim of its page table.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Page table of the victim changes
+ *
+ *----------------------------------------------------------------------
+ */
+static void writeBackDone(FaultContextPtr context)
+{
+    int waiter, slot;
+    PageTableEntryPtr victim;
+
+    slot = context->victimPid % MAXPROC;
+
+    MboxSend(frameMailbox, NULL, 0);
+    victim = &context->victimTable[context->victimPage];
+    victim->busy = NOT_BUSY;
+    waiter = victim->waiter;
+    victim->waiter = NO_REPLY;
+    if (pageTable[slot] != context->victimTable) {
+        releaseQuitPage(context->victimTable, context->victimPage);
+        waiter = NO_REPLY;
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+
+    if (waiter != NO_REPLY) {
+        MboxSend(waiter, NULL, 0);
+    }
+} /* writeBackDone */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * finishFault
+ *
+ * The last stage of the fault pipeline: copies the page read for the
+ * context into its frame, puts it in the page table and replies, then
+ * gives the context back.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Changes to the mmu, frameTable, and pageTable
+ *
+ *----------------------------------------------------------------------
+ */
+static void finishFault(int index)
+{
+    FaultContextPtr context;
+
+    context = &contexts[index];
+    readWriteToFrame(context->frame, vmRegion, context->inBuf);
+    installPage(&context->fault, context->table, context->frame);
+
+    MboxSend(diskMailbox, NULL, 0);
+    inFlight--;
+    MboxReceive(diskMailbox, NULL, 0);
+
+    MboxSend(contextMailbox, (void *) &index, sizeof(int));
+} /* finishFault */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * queueRequest
+ *
+ * Hands a disk request of the fault pipeline to the disk workers. A
+ * fault has at most two requests queued, so ioRequests never fills.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats.diskQueuePeak may change
+ *
+ *----------------------------------------------------------------------
+ */
+static void queueRequest(IoRequest *request)
+{
+    MboxSend(diskMailbox, NULL, 0);
+    ioRequests[ioQueued++] = *request;
+    if (ioQueued > vmStats.diskQueuePeak) {
+        vmStats.diskQueuePeak = ioQueued;
+    }
+    MboxReceive(diskMailbox, NULL, 0);
+
+    MboxSend(ioMailbox, NULL, 0);
+} /* queueRequest */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * nextRequest
+ *
+ * Picks the queued disk request a disk worker does next. Requests for
+ * a mapped file don't move the swap disk head and go first. The rest
+ * are taken in SCAN order, like the faults in nextFault. Must be
+ * called holding diskMailbox with a non-empty ioRequests.
+ *
+ * Results:
+ * Index into ioRequests
+ *
+ * Side effects:
+ * scanDirection may change
+ *
+ *----------------------------------------------------------------------
+ */
+static int nextRequest(void)
+{
+    int best, bestDistance, distance, unit, track;
+    FaultContextPtr context;
+
+    for (int turn = 0; turn < 2; turn++) {
+        best = -1;
+        bestDistance = numTracks;
+
+        for (int index = 0; index < ioQueued; index++) {
+            context = &contexts[ioRequests[index].context];
+            if (ioRequests[index].op == IO_WRITE_BACK) {
+                unit = context->outUnit;
+                track = context->outTrack;
+            }
+            else {
+                unit = context->inUnit;
+                track = context->inTrack;
+            }
+
+            if (unit != DISK1) {
+                return index;
+            }
+
+            distance = (track - diskHead) * scanDirection;
+            if (distance >= 0 && distance < bestDistance) {
+                best = index;
+                bestDistance = distance;
+            }
+        }
+
+        if (best != -1) {
+            return best;
+        }
+        scanDirection = -scanDirection;
+    }
+    return 0;
+} /* nextRequest */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * evictFrame
+ *
+ * Takes the page in a frame the clock algorithm handed us out of it,
+ * writing it to disk if it is dirty. If the process that owns the page
+ * has quit, the page isn't written and goes to the reclaim of its page
+ * table instead.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk write, page table of the owner changes
+ *
+ *----------------------------------------------------------------------
+ */
+static void evictFrame(int frameIndex, char *buf)
+{
+    int indexPageToSave, pidToSave, diskBlock, dirty, toFile, unit, sector;
+    int waiter;
+    FrameTableEntryPtr frameToUse;
+    PageTableEntryPtr table, pageToChange;
+
+    frameToUse = &frameTable[frameIndex];
+    indexPageToSave = frameToUse->pageNum;
+    pidToSave = frameToUse->pid;
+    vmStats.replaced++;
+
+    /* See if this is our first time storing frame on disk */
+    MboxSend(frameMailbox, NULL, 0);
+    table = ownerTable(pidToSave);
+    pageToChange = &table[indexPageToSave];
+    if (pageToChange->frame != frameIndex) {
+        MboxReceive(frameMailbox, NULL, 0);
+        return;
+    }
+    demoteCluster(table, indexPageToSave);
+
+    /* Dirty pages of a shared file mapping go back to the file, clean
+     * file pages can be read from it again. Nobody reads the swap copy
+     * of a page of a process that quit, but its file is still there. */
+    dirty = frameToUse->dirty >= DIRTY;
+    toFile = dirty && pageToChange->fileUnit != NOT_MAPPED &&
+                pageToChange->fileMode == VM_MAP_SHARED;
+    if (table != pageTable[pidToSave % MAXPROC]) {
+        dirty = toFile;
+    }
+    if (dirty && !toFile && pageToChange->diskBlock == NOT_ON_DISK) {
+        pageToChange->diskBlock = findOpenTrack();
+    }
+    diskBlock = pageToChange->diskBlock;
+    unit = pageToChange->fileUnit;
+    sector = pageToChange->fileSector;
+    MboxReceive(frameMailbox, NULL, 0);
+
+    /* Save frame into disk */
+    if (toFile) {
+        readWriteToFrame(frameIndex, buf, vmRegion);
+        writeFileSectors(unit, sector, buf, "Pager(): writing mapped file");
+    }
+    else if (dirty) {
+        /* Increment page out, copy frame to buffer then to disk */
+        vmStats.pageOuts++;
+        invalidateCheckpoint();
+
+        readWriteToFrame(frameIndex, buf, vmRegion);
+        writeTrack(diskBlock, buf, "Pager(): writing to disk");
+    }
+
+    /* Set page table entry on old process, if it is still around */
+    waiter = NO_REPLY;
+    MboxSend(frameMailbox, NULL, 0);
+    if (table != pageTable[pidToSave % MAXPROC]) {
+        releaseQuitPage(table, indexPageToSave);
+    }
+    else if (pageToChange->frame == frameIndex) {
+        if (EXACT_DIRTY && pageToChange->workingSet == IN_WORKING_SET) {
+            processes[pidToSave % MAXPROC].prepage++;
+        }
+        setPageEntryMembers(pidToSave, indexPageToSave, REFERENCED,
+                                PAGE_NOT_IN_FRAME, diskBlock);
+        processes[pidToSave % MAXPROC].pagesInUse--;
+        waiter = pageToChange->waiter;
+        pageToChange->waiter = NO_REPLY;
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+
+    /* VmLock waits for the page to leave its frame */
+    if (waiter != NO_REPLY) {
+        MboxSend(waiter, NULL, 0);
+    }
+} /* evictFrame */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * claimCluster
+ *
+ * Called with frameMailbox held. Checks whether the CLUSTER_PAGES
+ * group around pageNum can be brought in as one cluster: none of its
+ * pages may be in a frame or on their way in, none may be advised
+ * random, and either none of them is on disk or they are on tracks
+ * in a row, and none may be file backed. If so, claims a run of frames
+ * for it.
+ *
+ * Results:
+ * Returns the first frame of the run, or PAGE_NOT_IN_FRAME if the
+ * page has to be brought in on its own.
+ *
+ * Side effects:
+ * The pages of the group are marked BUSY.
+ *
+ *----------------------------------------------------------------------
+ */
+static int claimCluster(PageTableEntryPtr table, int pageNum, int priority)
+{
+    int first, firstBlock, frame;
+    PageTableEntryPtr pte;
+
+    first = pageNum - pageNum % CLUSTER_PAGES;
+    if (first + CLUSTER_PAGES > numPages) {
+        return PAGE_NOT_IN_FRAME;
+    }
+
+    firstBlock = table[first].diskBlock;
+    for (int page = first; page < first + CLUSTER_PAGES; page++) {
+        pte = &table[page];
+
+        if (pte->frame != PAGE_NOT_IN_FRAME || pte->busy == BUSY ||
+                pte->advice == VM_ADVISE_RANDOM ||
+                pte->fileUnit != NOT_MAPPED) {
+            return PAGE_NOT_IN_FRAME;
+        }
+
+        if (firstBlock == NOT_ON_DISK ? pte->diskBlock != NOT_ON_DISK :
+                pte->diskBlock != firstBlock + page - first) {
+            return PAGE_NOT_IN_FRAME;
+        }
+    }
+
+    frame = claimFrameRun(priority);
+    if (frame == PAGE_NOT_IN_FRAME) {
+        return PAGE_NOT_IN_FRAME;
+    }
+
+    for (int page = first; page < first + CLUSTER_PAGES; page++) {
+        table[page].busy = BUSY;
+    }
+
+    return frame;
+} /* claimCluster */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * serviceCluster
+ *
+ * Brings the group of pages claimed by claimCluster into the run of
+ * frames starting at firstFrame, replacing whatever is in them, and
+ * replies to the fault and to any faults that waited on the group.
+ * p1_switch maps the whole group when the process runs again.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Changes to the mmu, frameTable, and pageTable
+ *
+ *----------------------------------------------------------------------
+ */
+static void serviceCluster(FaultMsgPtr faultPtr, PageTableEntryPtr table,
+                            int firstFrame, char *buf)
+{
+    int pid, pageNum, first, frame, waiters[CLUSTER_PAGES];
+    PageTableEntryPtr pte;
+
+    pid = faultPtr->pid;
+    pageNum = faultPtr->offset / pageSize;
+    first = pageNum - pageNum % CLUSTER_PAGES;
+
+    evictCluster(firstFrame, buf);
+
+    /* The tracks are in a row, so this is one seek for the group */
+    for (int page = 0; page < CLUSTER_PAGES; page++) {
+        pte = &table[first + page];
+
+        if (pte->diskBlock != NOT_ON_DISK) {
+            vmStats.pageIns++;
+            readPageIn(pte->diskBlock, buf, "Pager(): reading cluster");
+        }
+        else {
+            memset(buf, 0, pageSize);
+        }
+        readWriteToFrame(firstFrame + page, vmRegion, buf);
+    }
+
+    MboxSend(frameMailbox, NULL, 0);
+
+    /* Same as servicePage if the process quit while we were at it */
+    if (pageTable[pid % MAXPROC] != table) {
+        for (int page = 0; page < CLUSTER_PAGES; page++) {
+            setFrameEntryMembers(NO_PID, firstFrame + page, UNREFERENCED,
+                    CLEAN, PAGE_NOT_IN_FRAME, NOT_USED, NOT_PAGER_OWNED);
+            releaseQuitPage(table, first + page);
+        }
+        vmStats.freeFrames += CLUSTER_PAGES;
+        MboxReceive(frameMailbox, NULL, 0);
+        return;
+    }
+
+    if (table[pageNum].state == UNREFERENCED) {
+        vmStats.new++;
+    }
+
+    for (int page = 0; page < CLUSTER_PAGES; page++) {
+        pte = &table[first + page];
+        frame = firstFrame + page;
+
+        setFrameEntryMembers(pid, frame, UNREFERENCED, CLEAN, first + page,
+                                USED, NOT_PAGER_OWNED);
+        setPageEntryMembers(pid, first + page, REFERENCED, frame,
+                                pte->diskBlock);
+        leaveZeroPage(pid, pte);
+        pte->cluster = CLUSTERED;
+        pte->busy = NOT_BUSY;
+        waiters[page] = pte->waiter;
+        pte->waiter = NO_REPLY;
+    }
+    processes[pid % MAXPROC].pagesInUse += CLUSTER_PAGES;
+    vmStats.promotions++;
+    MboxReceive(frameMailbox, NULL, 0);
+
+    for (int page = 0; page < CLUSTER_PAGES; page++) {
+        USLOSS_MmuSetAccess(firstFrame + page, 0);
+    }
+
+    if (faultPtr->replyMbox != NO_REPLY) {
+        faultLatency(faultPtr);
+        MboxSend(faultPtr->replyMbox, NULL, 0);
+    }
+    else {
+        vmStats.prefetched++;
+    }
+
+    for (int page = 0; page < CLUSTER_PAGES; page++) {
+        if (waiters[page] != NO_REPLY) {
+            MboxSend(waiters[page], NULL, 0);
+        }
+    }
+
+    /* Start on the next group of a sequential range */
+    if (faultPtr->replyMbox != NO_REPLY &&
+            table[pageNum].advice == VM_ADVISE_SEQUENTIAL &&
+            first + CLUSTER_PAGES < numPages &&
+            table[first + CLUSTER_PAGES].advice == VM_ADVISE_SEQUENTIAL) {
+        prefetchPage(pid, first + CLUSTER_PAGES);
+    }
+} /* serviceCluster */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * evictCluster
+ *
+ * Empties the run of frames claimFrameRun handed us. If the run holds
+ * a whole cluster it is written out as one, to tracks in a row;
+ * otherwise each page in the run is evicted on its own.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk writes, page tables of the owners change
+ *
+ *----------------------------------------------------------------------
+ */
+static void evictCluster(int firstFrame, char *buf)
+{
+    int pid, first, whole, dirty, track, write[CLUSTER_PAGES];
+    int waiters[CLUSTER_PAGES];
+    FrameTableEntryPtr frameToUse;
+    PageTableEntryPtr table;
+
+    frameToUse = &frameTable[firstFrame];
+    pid = frameToUse->pid;
+    first = frameToUse->pageNum;
+    dirty = 0;
+
+    MboxSend(frameMailbox, NULL, 0);
+    whole = frameToUse->used == USED && first % CLUSTER_PAGES == 0 &&
+                ownerTable(pid) == pageTable[pid % MAXPROC];
+    table = whole ? pageTable[pid % MAXPROC] : NULL;
+
+    for (int page = 0; whole && page < CLUSTER_PAGES; page++) {
+        frameToUse = &frameTable[firstFrame + page];
+
+        whole = frameToUse->used == USED && frameToUse->pid == pid &&
+                frameToUse->pageNum == first + page &&
+                table[first + page].frame == firstFrame + page &&
+                table[first + page].cluster == CLUSTERED;
+        write[page] = frameToUse->dirty >= DIRTY;
+        dirty |= write[page];
+    }
+
+    /* A cluster going to disk for the first time gets tracks in a row,
+     * and every page of it is written so that all of them are valid */
+    if (whole && dirty && table[first].diskBlock == NOT_ON_DISK) {
+        track = findOpenTracks(CLUSTER_PAGES);
+        if (track == -1) {
+            whole = 0;
+        }
+        else {
+            for (int page = 0; page < CLUSTER_PAGES; page++) {
+                table[first + page].diskBlock = track + page;
+                write[page] = 1;
+            }
+        }
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+
+    if (!whole) {
+        for (int frame = firstFrame; frame < firstFrame + CLUSTER_PAGES;
+                frame++) {
+            if (frameTable[frame].used == USED) {
+                evictFrame(frame, buf);
+            }
+        }
+        return;
+    }
+
+    vmStats.replaced += CLUSTER_PAGES;
+    for (int page = 0; page < CLUSTER_PAGES; page++) {
+        if (write[page]) {
+            vmStats.pageOuts++;
+            invalidateCheckpoint();
+
+            readWriteToFrame(firstFrame + page, buf, vmRegion);
+            writeTrack(table[first + page].diskBlock, buf,
+                        "Pager(): writing cluster");
+        }
+    }
+
+    /* Set page table entries on old process, if it is still around */
+    MboxSend(frameMailbox, NULL, 0);
+    for (int page = 0; page < CLUSTER_PAGES; page++) {
+        waiters[page] = NO_REPLY;
+        if (table != pageTable[pid % MAXPROC]) {
+            releaseQuitPage(table, first + page);
+        }
+        else if (table[first + page].frame == firstFrame + page) {
+            if (EXACT_DIRTY &&
+                    table[first + page].workingSet == IN_WORKING_SET) {
+                processes[pid % MAXPROC].prepage++;
+            }
+            setPageEntryMembers(pid, first + page, REFERENCED,
+                    PAGE_NOT_IN_FRAME, table[first + page].diskBlock);
+            table[first + page].cluster = NOT_CLUSTERED;
+            processes[pid % MAXPROC].pagesInUse--;
+            waiters[page] = table[first + page].waiter;
+            table[first + page].waiter = NO_REPLY;
+        }
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+
+    for (int page = 0; page < CLUSTER_PAGES; page++) {
+        if (waiters[page] != NO_REPLY) {
+            MboxSend(waiters[page], NULL, 0);
+        }
+    }
+} /* evictCluster */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * compactSwap
+ *
+ * Called by a pager with nothing to do. Moves one page on the swap
+ * disk towards a layout where the pages of each process sit on tracks
+ * in a row, in page order, one process after the other from track 0.
+ * Only pages that are out of their frames and not busy are moved; a
+ * page that can't be moved stays where it is and the pages after it
+ * are packed behind it. If the track a page should go to is taken,
+ * the page on it is moved out of the way first. Nothing is moved while
+ * another pager is servicing a fault or the disk workers have faults
+ * in the pipeline.
+ *
+ * Results:
+ * 1 if a page was moved, 0 if there is nothing (more) to do or the
+ * disk is wanted.
+ *
+ * Side effects:
+ * Disk reads and writes, diskBlock of the moved page changes
+ *
+ *----------------------------------------------------------------------
+ */
+static int compactSwap(char *buf)
+{
+    int next, slot, page, target, from, waiter, found, packed;
+    PageTableEntryPtr table, pte;
+
+    /* One pager at a time, and only while no other pager or disk
+     * worker wants the disk */
+    MboxSend(faultQueueMailbox, NULL, 0);
+    MboxSend(diskMailbox, NULL, 0);
+    found = compacting || busyPagers > 0 || inFlight > 0 || ioQueued > 0;
+    MboxReceive(diskMailbox, NULL, 0);
+    if (!found) {
+        compacting = 1;
+    }
+    MboxReceive(faultQueueMailbox, NULL, 0);
+    if (found) {
+        return 0;
+    }
+
+    MboxSend(frameMailbox, NULL, 0);
+
+    /* Find the first page that isn't where it should be */
+    next = 0;
+    found = 0;
+    packed = 1;
+    slot = 0;
+    page = 0;
+    target = NOT_ON_DISK;
+    for (int process = 0; !found && process < MAXPROC; process++) {
+        for (int index = 0; !found && index < numPages; index++) {
+            pte = &pageTable[process][index];
+
+            if (pte->diskBlock == NOT_ON_DISK) {
+                continue;
+            }
+
+            if (pte->diskBlock == next) {
+                next++;
+                continue;
+            }
+
+            /* Every page from here on isn't where it should be */
+            packed = 0;
+
+            if (pte->frame != PAGE_NOT_IN_FRAME || pte->busy == BUSY) {
+                if (pte->diskBlock > next) {
+                    next = pte->diskBlock + 1;
+                }
+                continue;
+            }
+
+            found = 1;
+            slot = process;
+            page = index;
+            target = next;
+        }
+    }
+
+    /* Move whatever is on the target track out of the way first */
+    if (found && tracksInUse[target] == USED) {
+        found = 0;
+        for (int process = 0; !found && process < MAXPROC; process++) {
+            for (int index = 0; !found && index < numPages; index++) {
+                pte = &pageTable[process][index];
+
+                if (pte->diskBlock == target) {
+                    found = pte->frame == PAGE_NOT_IN_FRAME &&
+                            pte->busy == NOT_BUSY;
+                    slot = process;
+                    page = index;
+                }
+            }
+        }
+
+        for (target = next + 1; found && target < numTracks &&
+                tracksInUse[target] == USED; target++)
+            ;
+        found = found && target < numTracks;
+    }
+
+    /* Nothing we can move; the swap disk only counts as compacted if
+     * every page is where it should be, not if something is in the way */
+    if (!found) {
+        MboxReceive(frameMailbox, NULL, 0);
+
+        MboxSend(faultQueueMailbox, NULL, 0);
+        compacting = 0;
+        if (packed) {
+            swapCompact = 1;
+        }
+        MboxReceive(faultQueueMailbox, NULL, 0);
+        return 0;
+    }
+
+    table = pageTable[slot];
+    pte = &table[page];
+    pte->busy = BUSY;
+    from = pte->diskBlock;
+    tracksInUse[target] = USED;
+    vmStats.freeDiskBlocks--;
+    swapCompact = 0;
+    MboxReceive(frameMailbox, NULL, 0);
+
+    /* The target may be a track the checkpoint image still points at */
+    invalidateCheckpoint();
+
+    readTrack(from, buf, "compactSwap(): reading from disk");
+    writeTrack(target, buf, "compactSwap(): writing to disk");
+
+    MboxSend(frameMailbox, NULL, 0);
+
+    /* Same as servicePage if the process quit while we were at it */
+    if (pageTable[slot] != table) {
+        releaseTrack(target);
+        releaseQuitPage(table, page);
+        MboxReceive(frameMailbox, NULL, 0);
+    }
+    else {
+        pte->diskBlock = target;
+        releaseTrack(from);
+        pte->busy = NOT_BUSY;
+        waiter = pte->waiter;
+        pte->waiter = NO_REPLY;
+        vmStats.compactMoves++;
+        MboxReceive(frameMailbox, NULL, 0);
+
+        /* The page is still on disk; the process faults on it again */
+        if (waiter != NO_REPLY) {
+            MboxSend(waiter, NULL, 0);
+        }
+    }
+
+    MboxSend(faultQueueMailbox, NULL, 0);
+    compacting = 0;
+    MboxReceive(faultQueueMailbox, NULL, 0);
+
+    return 1;
+} /* compactSwap */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Reclaimer
+ *
+ * Kernel process that gives back the frames and disk blocks of the
+ * processes that quit, so that quitting doesn't have to. p1_quit only
+ * wakes it; it swaps every slot whose process quit to its spare table,
+ * then reclaims each quit page table it hasn't been through yet.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Frames and tracks are freed
+ *
+ *----------------------------------------------------------------------
+ */
+static int Reclaimer(char *arg)
+{
+    QuitTablePtr quit;
+    PageTableEntryPtr table;
+    char *buf;
+
+    buf = (char *) malloc(sizeof(char) * pageSize);
+
+    while (1) {
+        if (MboxReceive(reclaimMailbox, NULL, 0) == MAILBOX_RELEASED) {
+            free(buf);
+            return 0;
+        }
+
+        for (int slot = 0; slot < MAXPROC; slot++) {
+            if (processes[slot].quitPid != NO_PID) {
+                swapQuitTable(slot);
+            }
+        }
+
+        /* p1_fork may have swapped some, so go by the quit tables */
+        while (1) {
+            MboxSend(frameMailbox, NULL, 0);
+            for (quit = quitTables; quit != NULL && quit->reclaimed;
+                    quit = quit->next)
+                ;
+            table = quit == NULL ? NULL : quit->table;
+            MboxReceive(frameMailbox, NULL, 0);
+
+            if (table == NULL) {
+                break;
+            }
+            flushFilePages(table, buf);
+            reclaimTable(table);
+        }
+    }
+    return 0;
+} /* Reclaimer */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * flushFilePages
+ *
+ * Writes the dirty pages of shared file mappings in the page table of
+ * a process that quit back to their file, before reclaimTable gives
+ * their frames away. Each frame is held as pager owned while it is
+ * written so that no pager takes it. A page a pager is evicting is
+ * written back by the pager (see evictFrame).
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk writes, the frames are marked clean
+ *
+ *----------------------------------------------------------------------
+ */
+static void flushFilePages(PageTableEntryPtr table, char *buf)
+{
+    int frame, write;
+    PageTableEntryPtr pte;
+
+    for (int page = 0; page < numPages; page++) {
+        pte = &table[page];
+        if (pte->fileUnit == NOT_MAPPED || pte->fileMode != VM_MAP_SHARED) {
+            continue;
+        }
+
+        MboxSend(frameMailbox, NULL, 0);
+        MboxSend(clockHandMailbox, NULL, 0);
+        frame = pte->frame;
+        write = frame != PAGE_NOT_IN_FRAME &&
+                frameTable[frame].pagerOwned == NOT_PAGER_OWNED &&
+                frameTable[frame].dirty >= DIRTY;
+        if (write) {
+            frameTable[frame].pagerOwned = PAGER_OWNED;
+        }
+        MboxReceive(clockHandMailbox, NULL, 0);
+        MboxReceive(frameMailbox, NULL, 0);
+
+        if (write) {
+            readWriteToFrame(frame, buf, vmRegion);
+            writeFileSectors(pte->fileUnit, pte->fileSector, buf,
+                            "Reclaimer(): writing mapped file");
+
+            MboxSend(clockHandMailbox, NULL, 0);
+            frameTable[frame].dirty = CLEAN;
+            frameTable[frame].pagerOwned = NOT_PAGER_OWNED;
+            MboxReceive(clockHandMailbox, NULL, 0);
+        }
+    }
+} /* flushFilePages */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * reclaimTable
+ *
+ * Frees every frame, pin and disk block in the page table of a process
+ * that quit. A page a pager is bringing in or evicting is left as it
+ * is; the pager gives it back with releaseQuitPage when it is done,
+ * and the last one to do so retires the table.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats.freeFrames, freeDiskBlocks and lockedFrames change
+ *
+ *----------------------------------------------------------------------
+ */
+static void reclaimTable(PageTableEntryPtr table)
+{
+    int pending;
+    QuitTablePtr quit;
+    PageTableEntryPtr pte;
+    FrameTableEntryPtr framePtr;
+
+    pending = 0;
+
+    MboxSend(frameMailbox, NULL, 0);
+    MboxSend(clockHandMailbox, NULL, 0);
+
+    for (int page = 0; page < numPages; page++) {
+        pte = &table[page];
+
+        if (pte->busy == BUSY || (pte->frame != PAGE_NOT_IN_FRAME &&
+                frameTable[pte->frame].pagerOwned == PAGER_OWNED)) {
+            pending++;
+            continue;
+        }
+
+        if (pte->frame != PAGE_NOT_IN_FRAME) {
+            framePtr = &frameTable[pte->frame];
+            setFrameEntryMembers(NO_PID, pte->frame, UNREFERENCED, CLEAN,
+                                PAGE_NOT_IN_FRAME, NOT_USED, NOT_PAGER_OWNED);
+            framePtr->locked = UNLOCKED;
+            vmStats.freeFrames++;
+        }
+
+        if (pte->locked == LOCKED) {
+            vmStats.lockedFrames--;
+        }
+
+        if (pte->diskBlock != NOT_ON_DISK) {
+            releaseTrack(pte->diskBlock);
+        }
+
+        clearPageEntry(pte);
+    }
+
+    quit = findQuitTable(table);
+    quit->reclaimed = 1;
+    quit->pending = pending;
+    if (pending == 0) {
+        retireQuitTable(quit);
+    }
+
+    MboxReceive(clockHandMailbox, NULL, 0);
+    MboxReceive(frameMailbox, NULL, 0);
+} /* reclaimTable */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * addQuitTable
+ *
+ * Called by swapQuitTable, with frameMailbox held, once the slot of pid
+ * has its spare page table. Keeps the page table pid had until it has
+ * been reclaimed and every pager holding one of its pages let go of it.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Memory is allocated
+ *
+ *----------------------------------------------------------------------
+ */
+void addQuitTable(int pid, PageTableEntryPtr table)
+{
+    QuitTablePtr quit;
+
+    quit = (QuitTablePtr) malloc(sizeof(QuitTable));
+    quit->pid = pid;
+    quit->slot = pid % MAXPROC;
+    quit->table = table;
+    quit->reclaimed = 0;
+    quit->pending = 0;
+    quit->next = quitTables;
+    quitTables = quit;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * swapQuitTable
+ *
+ * Called by the Reclaimer, and by p1_fork when a new process gets the
+ * slot before the Reclaimer has run. If the process of slot quit, the
+ * slot moves on to its spare page table and the old one is kept for
+ * the Reclaimer. Until then the pagers treat the process as running,
+ * and whatever they do to its page table is reclaimed with it.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * The slot's page table and counters change, memory may be allocated
+ *
+ *----------------------------------------------------------------------
+ */
+void swapQuitTable(int slot)
+{
+    Process *proc;
+    PageTableEntryPtr table;
+
+    proc = &processes[slot];
+
+    MboxSend(frameMailbox, NULL, 0);
+    if (proc->quitPid != NO_PID) {
+        table = pageTable[slot];
+        if (proc->spareTable == NULL) {
+            proc->spareTable = newPageTable();
+        }
+        pageTable[slot] = proc->spareTable;
+        proc->PageTable = proc->spareTable;
+        proc->spareTable = NULL;
+        proc->pagesInUse = 0;
+        proc->pagesLocked = 0;
+        proc->priority = MINPRIORITY;
+        proc->prepage = 0;
+        proc->zeroPages = 0;
+        proc->scanPage = 0;
+        addQuitTable(proc->quitPid, table);
+        proc->quitPid = NO_PID;
+    }
+    MboxReceive(frameMailbox, NULL, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * findQuitTable
+ *
+ * Called with frameMailbox held.
+ *
+ * Results:
+ * The QuitTable of table, NULL if the process of table hasn't quit.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+QuitTablePtr findQuitTable(PageTableEntryPtr table)
+{
+    QuitTablePtr quit;
+
+    for (quit = quitTables; quit != NULL; quit = quit->next) {
+        if (quit->table == table) {
+            break;
+        }
+    }
+
+    return quit;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ownerTable
+ *
+ * Called with frameMailbox held. Finds the page table of pid, which is
+ * the one of its slot unless pid quit; then the slot has moved on to
+ * its spare table while frames may still point at pages of the old one.
+ *
+ * Results:
+ * The page table of pid.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+PageTableEntryPtr ownerTable(int pid)
+{
+    for (QuitTablePtr quit = quitTables; quit != NULL; quit = quit->next) {
+        if (quit->pid == pid) {
+            return quit->table;
+        }
+    }
+
+    return pageTable[pid % MAXPROC];
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * releaseQuitPage
+ *
+ * Called with frameMailbox held by a pager that is done with a page of
+ * a process that quit. Gives back the disk block and pin of the page;
+ * the frame, if there is one, is the pager's. If reclaimTable already
+ * left this page to us and it was the last one, the table is retired.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats.freeDiskBlocks and lockedFrames change
+ *
+ *----------------------------------------------------------------------
+ */
+void releaseQuitPage(PageTableEntryPtr table, int pageNum)
+{
+    QuitTablePtr quit;
+    PageTableEntryPtr pte;
+
+    pte = &table[pageNum];
+    if (pte->locked == LOCKED) {
+        vmStats.lockedFrames--;
+    }
+    if (pte->diskBlock != NOT_ON_DISK) {
+        releaseTrack(pte->diskBlock);
+    }
+    clearPageEntry(pte);
+
+    quit = findQuitTable(table);
+    if (quit != NULL && quit->reclaimed) {
+        quit->pending--;
+        if (quit->pending == 0) {
+            retireQuitTable(quit);
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * retireQuitTable
+ *
+ * Called with frameMailbox held once nothing uses the page table of
+ * quit anymore. The table becomes the spare of its slot if the slot
+ * has none, and is freed otherwise.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Memory is freed
+ *
+ *----------------------------------------------------------------------
+ */
+void retireQuitTable(QuitTablePtr quit)
+{
+    QuitTablePtr *link;
+
+    for (link = &quitTables; *link != quit; link = &(*link)->next)
+        ;
+    *link = quit->next;
+
+    if (processes[quit->slot].spareTable == NULL) {
+        processes[quit->slot].spareTable = quit->table;
+    }
+    else {
+        free(quit->table);
+    }
+    free(quit);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * faultLatency
+ *
+ * Adds the time a fault took to be serviced to the stats for its
+ * priority.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats changes
+ *
+ *----------------------------------------------------------------------
+ */
+static void faultLatency(FaultMsgPtr faultPtr)
+{
+    int now;
+
+    gettimeofdayReal(&now);
+    vmStats.priorityFaults[faultPtr->priority]++;
+    vmStats.priorityLatency[faultPtr->priority] += now - faultPtr->queued;
+} /* faultLatency */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * setFrameEntryMembers
+ *
+ * Helper function to set member of a FrameTableEntry struct.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Will have changed the members of a FrameTableEntry struct
+ *
+ *----------------------------------------------------------------------
+ */
+
+void setFrameEntryMembers(int pid, int frameIndex, int state, int dirty, 
+                            int pageNum, int used, int pagerOwned)
+{
+    FrameTableEntryPtr frameToUpdate = &frameTable[frameIndex];
+
+    frameToUpdate->pid = pid;
+    frameToUpdate->state = state;
+    frameToUpdate->dirty = dirty;
+    frameToUpdate->pageNum = pageNum;
+    frameToUpdate->used = used;
+    frameToUpdate->pagerOwned = pagerOwned;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * setPageEntryMembers
+ *
+ * Helper function to set member of a PageTableEntry struct.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Will have changed the members of a PageTableEntry struct
+ *
+ *----------------------------------------------------------------------
+ */
+
+void setPageEntryMembers(int pid, int pageNum, int state,
+                            int frame, int diskBlock)
+{
+    PageTableEntryPtr pageToUpdate = &pageTable[pid % MAXPROC][pageNum];
+
+    pageToUpdate->state = state;
+    pageToUpdate->frame = frame;
+    pageToUpdate->diskBlock = diskBlock;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * clearPageEntry
+ *
+ * Helper function to put a PageTableEntry back to how it starts out.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Will have changed the members of a PageTableEntry struct
+ *
+ *----------------------------------------------------------------------
+ */
+
+void clearPageEntry(PageTableEntryPtr pte)
+{
+    pte->state = UNREFERENCED;
+    pte->frame = PAGE_NOT_IN_FRAME;
+    pte->diskBlock = NOT_ON_DISK;
+    pte->locked = UNLOCKED;
+    pte->advice = VM_ADVISE_NORMAL;
+    pte->busy = NOT_BUSY;
+    pte->waiter = NO_REPLY;
+    pte->cluster = NOT_CLUSTERED;
+    pte->workingSet = NOT_IN_WORKING_SET;
+    pte->fileUnit = NOT_MAPPED;
+    pte->fileSector = NOT_ON_DISK;
+    pte->fileMode = VM_MAP_SHARED;
+    pte->zeroMapped = NOT_ZERO_MAPPED;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * demoteCluster
+ *
+ * Helper function to break the cluster pageNum is part of back up into
+ * base pages, once one of its pages is evicted, dropped or pinned on
+ * its own.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats.demotions is incremented if the page was in a cluster
+ *
+ *----------------------------------------------------------------------
+ */
+
+void demoteCluster(PageTableEntryPtr table, int pageNum)
+{
+    int first;
+
+    if (table[pageNum].cluster != CLUSTERED) {
+        return;
+    }
+
+    first = pageNum - pageNum % CLUSTER_PAGES;
+    for (int page = first; page < first + CLUSTER_PAGES; page++) {
+        table[page].cluster = NOT_CLUSTERED;
+    }
+    vmStats.demotions++;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * leaveZeroPage
+ *
+ * Helper function for a page that gets a frame of its own while it is
+ * mapped to the zero frame, called with frameMailbox held.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats.zeroFramesSaved is decremented if the page was zero mapped
+ *
+ *----------------------------------------------------------------------
+ */
+
+void leaveZeroPage(int pid, PageTableEntryPtr pte)
+{
+    if (pte->zeroMapped == ZERO_MAPPED) {
+        pte->zeroMapped = NOT_ZERO_MAPPED;
+        processes[pid % MAXPROC].zeroPages--;
+        vmStats.zeroFramesSaved--;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * pageProtection
+ *
+ * Helper function to pick how a page in a frame is mapped. With
+ * EXACT_DIRTY a page stays read-only until it is written, so that
+ * writeFault can mark its frame dirty.
+ *
+ * Results:
+ * USLOSS_MMU_PROT_RW or USLOSS_MMU_PROT_READ
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int pageProtection(int frame)
+{
+    if (EXACT_DIRTY && frameTable[frame].dirty < DIRTY) {
+        return USLOSS_MMU_PROT_READ;
+    }
+
+    return USLOSS_MMU_PROT_RW;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * dropPage
+ *
+ * Helper function to throw away page pageNum of process pid, called
+ * with frameMailbox and clockHandMailbox held. Its frame and disk
+ * block are freed without writing anything back.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats.freeFrames and freeDiskBlocks change
+ *
+ *----------------------------------------------------------------------
+ */
+
+void dropPage(int pid, int pageNum)
+{
+    PageTableEntryPtr pte;
+
+    pte = &pageTable[pid % MAXPROC][pageNum];
+
+    if (pte->frame != PAGE_NOT_IN_FRAME) {
+        demoteCluster(pageTable[pid % MAXPROC], pageNum);
+
+        setFrameEntryMembers(NO_PID, pte->frame, UNREFERENCED, CLEAN,
+                                PAGE_NOT_IN_FRAME, NOT_USED, NOT_PAGER_OWNED);
+        USLOSS_MmuUnmap(TAG, pageNum);
+        vmStats.freeFrames++;
+        processes[pid % MAXPROC].pagesInUse--;
+    }
+
+    /* A zero mapped page is dropped without having cost a frame */
+    if (pte->zeroMapped == ZERO_MAPPED) {
+        pte->zeroMapped = NOT_ZERO_MAPPED;
+        USLOSS_MmuUnmap(TAG, pageNum);
+        processes[pid % MAXPROC].zeroPages--;
+    }
+
+    if (pte->diskBlock != NOT_ON_DISK) {
+        releaseTrack(pte->diskBlock);
+    }
+
+    setPageEntryMembers(pid, pageNum, UNREFERENCED, PAGE_NOT_IN_FRAME,
+                            NOT_ON_DISK);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * newPageTable
+ *
+ * Helper function to allocate a page table of numPages entries.
+ *
+ * Results:
+ * The new page table.
+ *
+ * Side effects:
+ * Memory is allocated
+ *
+ *----------------------------------------------------------------------
+ */
+
+PageTableEntryPtr newPageTable(void)
+{
+    PageTableEntryPtr table;
+
+    table = (PageTableEntryPtr) malloc(sizeof(PageTableEntry) * numPages);
+    for (int page = 0; page < numPages; page++) {
+        clearPageEntry(&table[page]);
+    }
+
+    return table;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * checkDiskStatus
+ *
+ * Helper function to check disk status
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Halt USLOSS
+ *
+ *----------------------------------------------------------------------
+ */
+
+void checkDiskStatus(int status, char *name)
+{
+    if (status != USLOSS_DEV_READY) {
+        USLOSS_Console("Error %s. Halting...");
+        USLOSS_Halt(1);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * readWriteToFrame
+ *
+ * Helper function to check disk status
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Reads or writes to a frame
+ *
+ *----------------------------------------------------------------------
+ */
+
+void readWriteToFrame(int frameIndex, void *dest, void *src)
+{
+    /* Map frame to PAGER_PAGE( == 0) then write or read from frame */  
+    USLOSS_MmuMap(TAG, PAGER_PAGE, frameIndex, USLOSS_MMU_PROT_RW);
+    memcpy(dest, src, pageSize);
+    USLOSS_MmuUnmap(TAG, PAGER_PAGE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
  * findOpenTrack
  *
  * Helper function to find an open track
@@ -715,9 +4503,346 @@ int findOpenTrack()
         }
     }
 
+    /* Checkpoint pages nobody claimed go before we run out */
+    if (releaseUnclaimed() > 0) {
+        return findOpenTrack();
+    }
+
     USLOSS_Console("findOpenTrack(): Not enough tracks. Halting...\n");
     USLOSS_Halt(1);
 
     return -1;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * releaseResumeEntry
+ *
+ * Called with frameMailbox held. Gives up a checkpoint entry nobody
+ * will adopt, and the disk block it kept reserved.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * vmStats.freeDiskBlocks changes
+ *
+ *----------------------------------------------------------------------
+ */
+void releaseResumeEntry(CheckpointEntry *entry)
+{
+    if (entry->diskBlock != NOT_ON_DISK) {
+        releaseTrack(entry->diskBlock);
+    }
+    entry->slot = NO_SLOT;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * releaseUnclaimed
+ *
+ * Called with frameMailbox held. Gives up every checkpoint entry no
+ * process has adopted with VmResume. This happens once a new checkpoint
+ * replaces the image, or when the swap disk would otherwise be full.
+ *
+ * Results:
+ * The number of entries given up.
+ *
+ * Side effects:
+ * vmStats.freeDiskBlocks changes
+ *
+ *----------------------------------------------------------------------
+ */
+int releaseUnclaimed(void)
+{
+    int released;
+
+    released = 0;
+    for (int index = 0; index < resumeCount; index++) {
+        if (resumeEntries[index].slot != NO_SLOT) {
+            releaseResumeEntry(&resumeEntries[index]);
+            released++;
+        }
+    }
+
+    return released;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * findOpenTracks
+ *
+ * Helper function to find count open tracks in a row. Like
+ * findOpenTrack, it gives up the checkpoint pages nobody claimed
+ * before it gives up itself.
+ *
+ * Results:
+ * The first of the tracks, or -1 if there is no such run.
+ *
+ * Side effects:
+ * The tracks are marked in use, unclaimed checkpoint entries may be
+ * released
+ *
+ *----------------------------------------------------------------------
+ */
+
+int findOpenTracks(int count)
+{
+    int run;
+
+    run = 0;
+    for (int track = 0; track < numTracks; track++) {
+        run = tracksInUse[track] == NOT_USED ? run + 1 : 0;
+
+        if (run == count) {
+            for (int used = track - count + 1; used <= track; used++) {
+                tracksInUse[used] = USED;
+            }
+            vmStats.freeDiskBlocks -= count;
+            return track - count + 1;
+        }
+    }
+
+    /* Checkpoint pages nobody claimed may be in the way */
+    if (releaseUnclaimed() > 0) {
+        return findOpenTracks(count);
+    }
+
+    return -1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * releaseTrack
+ *
+ * Helper function to give a track back
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * The track can be handed out by findOpenTrack again
+ *
+ *----------------------------------------------------------------------
+ */
+
+void releaseTrack(int track)
+{
+    if (tracksInUse[track] == USED) {
+        tracksInUse[track] = NOT_USED;
+        vmStats.freeDiskBlocks++;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * readTrack
+ *
+ * Helper function to read a page from a track of the swap disk
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk read, keeps track of where the disk head is
+ *
+ *----------------------------------------------------------------------
+ */
+
+void readTrack(int track, void *buf, char *name)
+{
+    seekTo(track, 0);
+    checkDiskStatus(diskReadReal(DISK1, track, TRACK_START,
+                        SECTORS_IN_FRAME, buf), name);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * readPageIn
+ *
+ * Helper function to read a faulted page from a track of the swap
+ * disk, like readTrack, but also counting how far the head moves for
+ * it apart for a compacted and a fragmented swap disk
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk read, vmStats.pageInSeeks and pageInSeekDistance change
+ *
+ *----------------------------------------------------------------------
+ */
+
+void readPageIn(int track, void *buf, char *name)
+{
+    seekTo(track, 1);
+    checkDiskStatus(diskReadReal(DISK1, track, TRACK_START,
+                        SECTORS_IN_FRAME, buf), name);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * writeTrack
+ *
+ * Helper function to write a page to a track of the swap disk
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk write, keeps track of where the disk head is
+ *
+ *----------------------------------------------------------------------
+ */
+
+void writeTrack(int track, void *buf, char *name)
+{
+    seekTo(track, 0);
+    checkDiskStatus(diskWriteReal(DISK1, track, TRACK_START,
+                        SECTORS_IN_FRAME, buf), name);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * seekTo
+ *
+ * Helper function to move the disk head to track before a swap disk
+ * read or write, counting the seek. Pagers and disk workers go to the
+ * disk at the same time, so this is done holding diskMailbox.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * diskHead and the seek statistics change
+ *
+ *----------------------------------------------------------------------
+ */
+
+void seekTo(int track, int pageIn)
+{
+    MboxSend(diskMailbox, NULL, 0);
+    if (pageIn) {
+        vmStats.pageInSeeks[swapCompact]++;
+        vmStats.pageInSeekDistance[swapCompact] += abs(track - diskHead);
+    }
+    vmStats.seeks++;
+    vmStats.seekDistance += abs(track - diskHead);
+    diskHead = track;
+    MboxReceive(diskMailbox, NULL, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * readFileSectors
+ *
+ * Helper function to read a page of a file mapped with VmMapFile from
+ * the SECTORS_IN_FRAME sectors starting at sector, one read per track
+ * they are on
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk read
+ *
+ *----------------------------------------------------------------------
+ */
+
+void readFileSectors(int unit, int sector, void *buf, char *name)
+{
+    int count;
+    char *dest;
+
+    vmStats.fileIns++;
+
+    dest = (char *) buf;
+    for (int done = 0; done < SECTORS_IN_FRAME; done += count) {
+        count = sectorsInTrack(unit, sector + done);
+        if (count > SECTORS_IN_FRAME - done) {
+            count = SECTORS_IN_FRAME - done;
+        }
+        checkDiskStatus(diskReadReal(unit, (sector + done) / trackSize[unit],
+                            (sector + done) % trackSize[unit], count,
+                            dest + done * (pageSize / SECTORS_IN_FRAME)),
+                        name);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * writeFileSectors
+ *
+ * Helper function to write a page back to a file mapped with VmMapFile,
+ * the same way readFileSectors reads it
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Disk write
+ *
+ *----------------------------------------------------------------------
+ */
+
+void writeFileSectors(int unit, int sector, void *buf, char *name)
+{
+    int count;
+    char *src;
+
+    vmStats.fileOuts++;
+
+    src = (char *) buf;
+    for (int done = 0; done < SECTORS_IN_FRAME; done += count) {
+        count = sectorsInTrack(unit, sector + done);
+        if (count > SECTORS_IN_FRAME - done) {
+            count = SECTORS_IN_FRAME - done;
+        }
+        checkDiskStatus(diskWriteReal(unit, (sector + done) / trackSize[unit],
+                            (sector + done) % trackSize[unit], count,
+                            src + done * (pageSize / SECTORS_IN_FRAME)),
+                        name);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * sectorsInTrack
+ *
+ * Helper function for the sectors of a file mapped with VmMapFile
+ *
+ * Results:
+ * The number of sectors from sector to the end of its track.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int sectorsInTrack(int unit, int sector)
+{
+    return trackSize[unit] - sector % trackSize[unit];
+}
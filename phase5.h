@@ -26,9 +26,134 @@
 #define PAGER_PRIORITY	2
 
 /*
- * Maximum number of pagers.
+ * The pager pool starts with the pagers VmInit asks for, grows past
+ * that on demand and shrinks back when faults are rare. It never has
+ * more pagers than POOL_MAX_PAGERS, than frames, or than frames the
+ * clock algorithm can replace; see poolLimit and replaceableFrames.
  */
-#define MAXPAGERS 4
+#define POOL_MAX_PAGERS (MAXPROC / 4)
+
+/*
+ * The pager pool grows by one when more than POOL_GROW_DEPTH faults are
+ * queued per pager, or the oldest queued fault has waited POOL_GROW_WAIT
+ * microseconds. A pager above the VmInit count leaves the pool once the
+ * fault queue hasn't held more than one fault for POOL_IDLE.
+ */
+#define POOL_GROW_DEPTH 2
+#define POOL_GROW_WAIT  50000
+#define POOL_IDLE       500000
+
+/*
+ * Pagers above the VmInit count are woken every POOL_TICK seconds while
+ * faults are rare, so one that sits idle still gets to leave the pool.
+ */
+#define POOL_TICK       1
+
+/*
+ * Size of the queue the pagers drain pagersMailbox into, and the number
+ * of buckets in the queue depth histogram (the last bucket counts every
+ * depth from QUEUE_DEPTH_BUCKETS up).
+ */
+#define FAULT_QUEUE_SIZE    (2 * MAXPROC)
+#define QUEUE_DEPTH_BUCKETS 8
+
+/*
+ * A queued fault is treated as one priority level higher for every
+ * FAULT_AGING microseconds it has waited. Prefetches are queued at
+ * PREFETCH_PRIORITY, below every process, and pick their frame as a
+ * MINPRIORITY process would.
+ */
+#define FAULT_AGING       20000
+#define PREFETCH_PRIORITY (MINPRIORITY + 1)
+
+/*
+ * Maximum number of pages a single process may pin with VmLock.
+ */
+#define MAXLOCKEDPAGES 8
+
+/*
+ * System call numbers for the VM calls that aren't part of usyscall.h.
+ * They are taken from the top of the system call vector.
+ */
+#define SYS_VMLOCK      (MAXSYSCALLS - 1)
+#define SYS_VMUNLOCK    (MAXSYSCALLS - 2)
+#define SYS_VMADVISE    (MAXSYSCALLS - 3)
+#define SYS_VMCHECKPOINT (MAXSYSCALLS - 4)
+#define SYS_VMSETPRIORITY (MAXSYSCALLS - 5)
+#define SYS_VMMAPFILE   (MAXSYSCALLS - 6)
+#define SYS_VMRESUME    (MAXSYSCALLS - 7)
+#define SYS_VMUNMAPFILE (MAXSYSCALLS - 8)
+
+/*
+ * Hints for VmAdvise.
+ */
+#define VM_ADVISE_NORMAL      0   // Default replacement, no read-ahead
+#define VM_ADVISE_SEQUENTIAL  1   // Read ahead, drop pages behind the scan
+#define VM_ADVISE_RANDOM      2   // No read-ahead
+#define VM_ADVISE_WILLNEED    3   // Start reading the range in now
+#define VM_ADVISE_DONTNEED    4   // Throw the range away
+
+/*
+ * Modes for VmMapFile.
+ */
+#define VM_MAP_SHARED   0   // Dirty pages are written back to the file
+#define VM_MAP_PRIVATE  1   // Dirty pages go to swap, the file is untouched
+
+/*
+ * Number of pages read ahead on a fault in a VM_ADVISE_SEQUENTIAL range.
+ */
+#define READ_AHEAD_PAGES 2
+
+/*
+ * Most pages of its working set a process asks the pagers to bring back
+ * at its first fault after being switched in. Set to 0 to turn
+ * prepaging off.
+ */
+#define PREPAGE_LIMIT 8
+
+/*
+ * Set to 1 to have VmResume prefetch the pages that were in frames when
+ * the checkpoint it resumes from was taken.
+ */
+#define CHECKPOINT_PRELOAD 1
+
+/*
+ * Number of pages the pagers bring in, map and evict as one cluster.
+ * A cluster is an aligned group of pages that goes into a run of
+ * frames and a run of tracks of the same length. Set to 1 to page
+ * base pages only.
+ */
+#define CLUSTER_PAGES 4
+
+/*
+ * Set to 1 to have idle pagers move pages on the swap disk so that the
+ * pages of a process end up on tracks in a row, in page order.
+ */
+#define SWAP_COMPACTION 1
+
+/*
+ * Set to 1 to keep a frame of zeroes that pages which were never
+ * written are mapped to, read-only, until they are written to.
+ */
+#define ZERO_PAGE 1
+
+/*
+ * Set to 1 to map pages read-only until they are first written, so
+ * that the frame table knows exactly which frames are dirty and
+ * p1_switch doesn't need to read the access bits. The working set of
+ * a process is then the pages it faulted in.
+ */
+#define EXACT_DIRTY 0
+
+/*
+ * Set above 0 to have that many disk worker processes do the disk I/O
+ * of faults, so a pager can go on to the next fault while the victim
+ * is written and the page read. At most MAX_IN_FLIGHT faults are in
+ * that pipeline at once, each with a write-back and a page-in queued.
+ */
+#define DISK_WORKERS 2
+#define MAX_IN_FLIGHT 8
+#define IO_QUEUE_SIZE (2 * MAX_IN_FLIGHT)
 
 /*
 * Disk defines
@@ -52,6 +177,36 @@ typedef struct VmStats {
     int replaced;       // # pages replaced; i.e., frame had a page and we
                         //   replaced that page in the frame with a different
                         //   page. */
+    int lockedFrames;   // # frames currently pinned by VmLock
+    int prefetched;     // # pages read in before they were faulted on
+    int resumed;        // # pages adopted from the last checkpoint
+    int seeks;          // # swap disk reads and writes
+    int seekDistance;   // total # of tracks the disk head moved for them
+    int queueDepth[QUEUE_DEPTH_BUCKETS]; // # times a pager found this
+                                         //   many faults queued
+    int pagerStarts;    // # pagers added to the pool after VmInit
+    int pagerExits;     // # pagers that left the pool while idle
+    int pagerPeak;      // largest size the pager pool reached
+    int priorityFaults[MINPRIORITY + 1];  // # faults, by priority
+    int priorityLatency[MINPRIORITY + 1]; // total time (us) they waited
+    int promotions;     // # page groups brought in as one cluster
+    int demotions;      // # clusters broken back up into base pages
+    int prepaged;       // # working set pages queued for page-in after
+                        //   their process was switched back in
+    int fileIns;        // # pages read from files mapped with VmMapFile
+    int fileOuts;       // # dirty pages written back to those files
+    int compactMoves;   // # pages moved on the swap disk by compaction
+    int pageInSeeks[2];        // # page-ins from swap, while it was
+                               //   fragmented [0] and compacted [1]
+    int pageInSeekDistance[2]; // total # of tracks the head moved for them
+    int zeroMappings;   // # faults given the zero frame
+    int zeroFramesSaved; // # of them that were never written to, and so
+                         //   never needed a frame
+    int writeFaults;    // # first writes to a page in a frame, caught by
+                        //   mapping it read-only
+    int pipelined;      // # faults handed to the disk workers
+    int inFlightPeak;   // most faults that were in the pipeline at once
+    int diskQueuePeak;  // most disk requests waiting for a disk worker
 } VmStats;
 
 
@@ -61,11 +216,20 @@ extern int *tracksInUse;
 extern FrameTableEntryPtr frameTable;
 extern int vmStarted;
 extern int numPages;
+extern int numFrames;
 extern int frameMailbox;
+extern int zeroFrame;
+extern int reclaimMailbox;
 extern VmStats  vmStats;
 
 /* Function Prototypes */
 extern  int  start5(char *);
+extern  PageTableEntryPtr newPageTable(void);
+extern  void swapQuitTable(int slot);
+extern  int pageProtection(int frame);
+
+/* From the phase 4 solution, like the disk calls in providedPrototypes.h */
+extern  int  sleepReal(int seconds);
 
 
 #endif /* _PHASE5_H */
@@ -9,12 +9,20 @@
 #define SECTORS_IN_FRAME     8
 #define PAGER_PAGE           0
 #define NO_PID              -1
+#define NO_REPLY            -1
+#define NOT_MAPPED          -1
 
 #define TRACK_START          0
 
+#define CHECKPOINT_MAGIC     0x564d434c
+
 /* Mailbox status */
 #define MAILBOX_RELEASED     -3
 
+/* Requests to the pager pool */
+#define POOL_GROW            1
+#define POOL_SHRINK          2
+
 
 /* VM started macro */
 #define VM_STARTED        1
@@ -35,6 +43,33 @@
 #define NOT_USED        0
 #define USED            1
 
+// For pages pinned in memory with VmLock
+#define UNLOCKED        0
+#define LOCKED          1
+
+// For pages that a pager is bringing in
+#define NOT_BUSY        0
+#define BUSY            1
+
+// For pages that are in frames as part of a cluster
+#define NOT_CLUSTERED   0
+#define CLUSTERED       1
+
+// For pages the process referenced the last time it ran
+#define NOT_IN_WORKING_SET  0
+#define IN_WORKING_SET      1
+
+// For checkpoint entries VmResume has taken or given up
+#define NO_SLOT -1
+
+// For pages mapped read-only to the zero frame
+#define NOT_ZERO_MAPPED     0
+#define ZERO_MAPPED         1
+
+// Disk requests of the fault pipeline
+#define IO_WRITE_BACK   1
+#define IO_PAGE_IN      2
+
 /* You'll probably want more states */
 
 /*
@@ -44,6 +79,17 @@ typedef struct PageTableEntry {
     int  state;      // See above.
     int  frame;      // Frame that stores the page (if any). -1 if none.
     int  diskBlock;  // Disk block that stores the page (if any). -1 if none.
+    int  locked;     // LOCKED if the page is pinned in its frame.
+    int  advice;     // Access pattern given with VmAdvise.
+    int  busy;       // BUSY while a pager is bringing the page in.
+    int  waiter;     // Reply mailbox of a fault waiting on a BUSY page,
+                     //   or of VmLock waiting for the page's eviction.
+    int  cluster;    // CLUSTERED while in frames with its CLUSTER_PAGES group.
+    int  workingSet; // IN_WORKING_SET if referenced during the last run.
+    int  fileUnit;   // Disk unit of the file mapped here, NOT_MAPPED if none.
+    int  fileSector; // First sector of the file that backs the page.
+    int  fileMode;   // VM_MAP_SHARED or VM_MAP_PRIVATE.
+    int  zeroMapped; // ZERO_MAPPED while mapped read-only to the zero frame.
     // Add more stuff here
 } PageTableEntry;
 
@@ -52,8 +98,18 @@ typedef struct PageTableEntry {
  */
 typedef struct Process {
     int  numPages;   // Size of the page table.
-    int pagesInUse;
+    int pagesInUse;  // # of pages in frames.
+    int pagesLocked; // # of pages pinned with VmLock, see MAXLOCKEDPAGES
+    int priority;    // Fault priority, from the parent or VmSetPriority.
+    int prepage;     // # working set pages found out of frames on switch-in.
+    int zeroPages;   // # of pages mapped to the zero frame.
+    int scanPage;    // Page of the last fault in a VM_ADVISE_SEQUENTIAL
+                     //   range; the pages below it are behind the scan.
     PageTableEntry *PageTable; // The page table for the process.
+    PageTableEntry *spareTable; // Page table the slot switches to once
+                                //   the process quits.
+    int quitPid;     // Process that quit but still has the page table,
+                     //   NO_PID once swapQuitTable moved the slot on.
 } Process;
 
 /*
@@ -63,10 +119,56 @@ typedef struct Process {
 typedef struct FaultMsg {
     int  pid;        // Process with the problem.
     int  offset;      // Address that caused the fault.
-    int  replyMbox;  // Mailbox to send reply.
+    int  replyMbox;  // Mailbox to send reply, NO_REPLY for a prefetch.
+    int  priority;   // Priority of the faulting process.
+    int  queued;     // Time of day the fault was sent to the pagers.
     // Add more stuff here.
 } FaultMsg;
 
+/*
+ * Page table of a process that quit, kept from the time its slot is
+ * swapped to the spare table (see swapQuitTable) until the reclaimer
+ * and every pager that held one of its pages are done with it. Only the
+ * last of them stores or frees the table.
+ */
+typedef struct QuitTable {
+    int  pid;                   // The process that quit.
+    int  slot;                  // pid % MAXPROC.
+    PageTableEntry *table;      // The page table it had.
+    int  reclaimed;             // 1 once the reclaimer went through it.
+    int  pending;               // # pages pagers held then, not given back.
+    struct QuitTable *next;
+} QuitTable;
+
+/*
+ * A fault in the pipeline of the disk workers, from the time its frame
+ * is chosen until the page is in it.
+ */
+typedef struct FaultContext {
+    FaultMsg fault;             // The fault being serviced.
+    PageTableEntry *table;      // Page table of the faulting process.
+    int  frame;                 // Frame the page goes in.
+    int  pending;               // # disk requests not done yet.
+    int  victimPid;             // Process whose dirty page is written back.
+    int  victimPage;            // Its page number.
+    PageTableEntry *victimTable; // Its page table, NULL if no write-back.
+    int  outUnit;               // Disk unit and track of the write-back,
+    int  outTrack;              //   first sector for a mapped file.
+    int  inUnit;                // Disk unit and track of the page-in, first
+    int  inTrack;               //   sector for a mapped file. inUnit is
+                                //   NOT_MAPPED for a new page.
+    char *inBuf;                // The page read in.
+    char *outBuf;               // The page written back.
+} FaultContext;
+
+/*
+ * Message to a disk worker.
+ */
+typedef struct IoRequest {
+    int  context;    // Index of the FaultContext.
+    int  op;         // IO_WRITE_BACK or IO_PAGE_IN.
+} IoRequest;
+
 /*
  *  Frames structure that keeps track of the frames created
  */
@@ -77,13 +179,39 @@ typedef struct FrameTableEntry {
     int dirty;
     int pid;
     int pageNum;
+    int locked;     // LOCKED frames are skipped by the clock algorithm
 } FrameTableEntry;
 
 
+/*
+ * Checkpoint image kept at the end of the swap disk. The header is
+ * followed by one entry for every page that has a disk block or is
+ * mapped to a file.
+ */
+typedef struct CheckpointHeader {
+    int magic;       // CHECKPOINT_MAGIC if the image is valid.
+    int pages;       // numPages when the image was written.
+    int tracks;      // numTracks when the image was written.
+    int entries;     // # of CheckpointEntry that follow.
+} CheckpointHeader;
+
+typedef struct CheckpointEntry {
+    int slot;        // Page table (pid % MAXPROC) the page belongs to.
+    int page;        // Page number.
+    int diskBlock;   // Disk block holding the page, -1 if none.
+    int resident;    // 1 if the page was in a frame at checkpoint time.
+    int fileUnit;    // File mapping of the page, see PageTableEntry.
+    int fileSector;
+    int fileMode;
+} CheckpointEntry;
+
+
 /* typedefs */
 typedef struct PageTableEntry *PageTableEntryPtr;
 typedef struct FrameTableEntry *FrameTableEntryPtr;
 typedef struct FaultMsg *FaultMsgPtr;
+typedef struct FaultContext *FaultContextPtr;
+typedef struct QuitTable *QuitTablePtr;
 
 
 #define CheckMode() assert(USLOSS_PsrGet() & USLOSS_PSR_CURRENT_MODE)